@@ -0,0 +1,130 @@
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "sysmon.h"
+#include "adaptive.h"
+
+void adaptive_init(adaptive_t *adaptive)
+{
+    (void)memset(adaptive, 0, sizeof(*adaptive));
+    adaptive->min_ms = 100;
+    adaptive->max_ms = 5000;
+    adaptive->idle_samples = 5;
+    adaptive->threshold[ADAPTIVE_CPU] = 10.0;
+    adaptive->threshold[ADAPTIVE_NET] = 100000.0;
+    adaptive->threshold[ADAPTIVE_TEMP] = 2000.0;
+}
+
+int adaptive_config(adaptive_t *adaptive, const char *name, const char *value)
+{
+    if (EQU(name, "adaptive_sampling"))
+    {
+        adaptive->enabled = atoi(value);
+    }
+    else if (EQU(name, "sample_period_min"))
+    {
+        adaptive->min_ms = (uint32_t)strtoul(value, NULL, 10);
+    }
+    else if (EQU(name, "sample_period_max"))
+    {
+        adaptive->max_ms = (uint32_t)strtoul(value, NULL, 10);
+    }
+    else if (EQU(name, "adaptive_idle_samples"))
+    {
+        adaptive->idle_samples = atoi(value);
+    }
+    else if (EQU(name, "adaptive_cpu_delta"))
+    {
+        adaptive->threshold[ADAPTIVE_CPU] = atof(value);
+    }
+    else if (EQU(name, "adaptive_net_delta"))
+    {
+        adaptive->threshold[ADAPTIVE_NET] = atof(value);
+    }
+    else if (EQU(name, "adaptive_temp_delta"))
+    {
+        adaptive->threshold[ADAPTIVE_TEMP] = atof(value);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+void adaptive_start(adaptive_t *adaptive, uint32_t period_ms)
+{
+    if (adaptive->min_ms == 0)
+        adaptive->min_ms = 1;
+    if (adaptive->max_ms < adaptive->min_ms)
+        adaptive->max_ms = adaptive->min_ms;
+    if (period_ms < adaptive->min_ms)
+        period_ms = adaptive->min_ms;
+    if (period_ms > adaptive->max_ms)
+        period_ms = adaptive->max_ms;
+    adaptive->period_ms = period_ms;
+    adaptive->primed = 0;
+    adaptive->flat = 0;
+    adaptive->wakeups = 0;
+    clock_gettime(CLOCK_MONOTONIC, &adaptive->start);
+}
+
+/**
+ * Feed the watched signals of the last sample.
+ * Any change above its threshold halves the period (down to min_ms),
+ * idle_samples flat samples in a row grow it by half (up to max_ms).
+ * Return the new period in ms when it changed, 0 otherwise
+ */
+uint32_t adaptive_update(adaptive_t *adaptive, const double *values)
+{
+    int busy = 0;
+    uint32_t period = adaptive->period_ms;
+    adaptive->wakeups++;
+    if (!adaptive->enabled)
+        return 0;
+    for (int i = 0; i < ADAPTIVE_N_SIGNALS; i++)
+    {
+        if (isnan(values[i]))
+            continue;
+        if (adaptive->primed && adaptive->threshold[i] > 0.0 &&
+            fabs(values[i] - adaptive->last[i]) > adaptive->threshold[i])
+            busy = 1;
+        adaptive->last[i] = values[i];
+    }
+    if (!adaptive->primed)
+    {
+        adaptive->primed = 1;
+        return 0;
+    }
+    if (busy)
+    {
+        adaptive->flat = 0;
+        period /= 2;
+    }
+    else if (++adaptive->flat >= adaptive->idle_samples)
+    {
+        adaptive->flat = 0;
+        period += period / 2 + 1;
+    }
+    if (period < adaptive->min_ms)
+        period = adaptive->min_ms;
+    if (period > adaptive->max_ms)
+        period = adaptive->max_ms;
+    if (period == adaptive->period_ms)
+        return 0;
+    adaptive->period_ms = period;
+    return period;
+}
+
+double adaptive_wakeups_per_min(adaptive_t *adaptive)
+{
+    struct timespec now;
+    double elapsed;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - adaptive->start.tv_sec) + (now.tv_nsec - adaptive->start.tv_nsec) / 1.0e9;
+    // the first sample is taken right at start, the timer woke us up for the following ones
+    if (elapsed <= 0.0 || adaptive->wakeups < 2)
+        return 0.0;
+    return (adaptive->wakeups - 1) * 60.0 / elapsed;
+}
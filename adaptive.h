@@ -0,0 +1,39 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*watched signals, a change above the threshold speeds the sampling up*/
+typedef enum
+{
+    ADAPTIVE_CPU = 0,
+    ADAPTIVE_NET,
+    ADAPTIVE_TEMP,
+    ADAPTIVE_N_SIGNALS
+} adaptive_signal_t;
+
+typedef struct
+{
+    int enabled;
+    uint32_t min_ms;
+    uint32_t max_ms;
+    /*current (effective) period*/
+    uint32_t period_ms;
+    double threshold[ADAPTIVE_N_SIGNALS];
+    double last[ADAPTIVE_N_SIGNALS];
+    int primed;
+    /*number of flat samples before backing off*/
+    int idle_samples;
+    int flat;
+    uint64_t wakeups;
+    struct timespec start;
+} adaptive_t;
+
+void adaptive_init(adaptive_t *adaptive);
+int adaptive_config(adaptive_t *adaptive, const char *name, const char *value);
+void adaptive_start(adaptive_t *adaptive, uint32_t period_ms);
+uint32_t adaptive_update(adaptive_t *adaptive, const double *values);
+double adaptive_wakeups_per_min(adaptive_t *adaptive);
+
+#endif
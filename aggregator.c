@@ -0,0 +1,679 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "aggregator.h"
+
+#define AGG_MAX_EVENTS 64
+#define AGG_MAX_LINE (1 << 20)
+#define AGG_READ_CHUNK 4096
+
+static const char *agg_keys[AGG_N_KEYS] = {
+    [AGG_CPU_USAGE] = "cpu_usages",
+    [AGG_CPU_TEMP] = "cpu_temp",
+    [AGG_MEM_AVAILABLE] = "mem_available",
+    [AGG_MEM_USED] = "mem_used",
+    [AGG_DISK_FREE] = "disk_free",
+    [AGG_BATTERY_PERCENT] = "battery_percent",
+};
+
+/*rollup names, cpu_usages[0] is the average usage*/
+static const char *agg_names[AGG_N_KEYS] = {
+    [AGG_CPU_USAGE] = "cpu_usage",
+    [AGG_CPU_TEMP] = "cpu_temp",
+    [AGG_MEM_AVAILABLE] = "mem_available",
+    [AGG_MEM_USED] = "mem_used",
+    [AGG_DISK_FREE] = "disk_free",
+    [AGG_BATTERY_PERCENT] = "battery_percent",
+};
+
+typedef struct
+{
+    char host[64];
+    int is_event;
+    double values[AGG_N_KEYS];
+} agg_fields_t;
+
+static uint32_t hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name)
+    {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/*return the position after the closing quote, NULL when the string is not terminated*/
+static const char *skip_string(const char *ptr, const char *end)
+{
+    // ptr is after the opening quote
+    while (ptr < end && *ptr != '"')
+    {
+        if (*ptr == '\\')
+            ptr++;
+        ptr++;
+    }
+    return ptr < end ? ptr + 1 : NULL;
+}
+
+/**
+ * Copy a string value still escaped, as it is written back in the fleet
+ * record, cut before an escape sequence that does not fit
+ */
+static void copy_escaped(char *dst, size_t size, const char *src, size_t len)
+{
+    size_t n = 0, step;
+    while (n < len)
+    {
+        step = 1;
+        if (src[n] == '\\')
+            step = (n + 1 < len && src[n + 1] == 'u') ? 6 : 2;
+        if (n + step > len || n + step > size - 1)
+            break;
+        n += step;
+    }
+    (void)memcpy(dst, src, n);
+    dst[n] = '\0';
+}
+
+/**
+ * Single pass over a record: pick the top level fields used by the
+ * aggregator without building any document tree. The record is embedded
+ * verbatim in the fleet record: return -1 when it is not a complete object
+ */
+static int scan_record(const char *line, size_t len, agg_fields_t *fields)
+{
+    const char *ptr = line, *end = line + len, *key, *key_end;
+    int depth = 0;
+    fields->host[0] = '\0';
+    fields->is_event = 0;
+    for (int i = 0; i < AGG_N_KEYS; i++)
+        fields->values[i] = NAN;
+    if (len == 0 || *ptr != '{')
+        return -1;
+    while (ptr < end)
+    {
+        switch (*ptr)
+        {
+        case '{':
+        case '[':
+            depth++;
+            ptr++;
+            break;
+        case '}':
+        case ']':
+            if (--depth < 0)
+                return -1;
+            ptr++;
+            if (depth == 0)
+            {
+                // nothing but blanks may follow the closing brace of the record
+                while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r'))
+                    ptr++;
+                return ptr == end ? 0 : -1;
+            }
+            break;
+        case '"':
+            key = ptr + 1;
+            ptr = skip_string(key, end);
+            if (!ptr)
+                return -1;
+            if (depth != 1)
+                break;
+            key_end = ptr - 1;
+            while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+                ptr++;
+            if (ptr >= end || *ptr != ':')
+                break;
+            ptr++;
+            while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+                ptr++;
+            if ((size_t)(key_end - key) == 4 && strncmp(key, "host", 4) == 0 && ptr < end && *ptr == '"')
+            {
+                const char *value = ptr + 1;
+                ptr = skip_string(value, end);
+                if (!ptr)
+                    return -1;
+                copy_escaped(fields->host, sizeof(fields->host), value, (size_t)(ptr - 1 - value));
+                break;
+            }
+            if ((size_t)(key_end - key) == 5 && strncmp(key, "event", 5) == 0)
+            {
+                fields->is_event = 1;
+                break;
+            }
+            for (int i = 0; i < AGG_N_KEYS; i++)
+            {
+                size_t n = strlen(agg_keys[i]);
+                if ((size_t)(key_end - key) == n && strncmp(key, agg_keys[i], n) == 0)
+                {
+                    const char *num = (*ptr == '[') ? ptr + 1 : ptr;
+                    char *num_end;
+                    double value = strtod(num, &num_end);
+                    if (num_end != num)
+                        fields->values[i] = value;
+                    break;
+                }
+            }
+            break;
+        default:
+            ptr++;
+            break;
+        }
+    }
+    // the record was cut before its closing brace
+    return -1;
+}
+
+static int index_build(aggregator_t *agg, int cap)
+{
+    int *index = (int *)malloc(cap * sizeof(int));
+    if (!index)
+        return -1;
+    for (int i = 0; i < cap; i++)
+        index[i] = -1;
+    for (int i = 0; i < agg->n_hosts; i++)
+    {
+        uint32_t slot = hash_name(agg->hosts[i].name) & (cap - 1);
+        while (index[slot] != -1)
+            slot = (slot + 1) & (cap - 1);
+        index[slot] = i;
+    }
+    if (agg->index)
+        free(agg->index);
+    agg->index = index;
+    agg->index_cap = cap;
+    return 0;
+}
+
+static int index_grow(aggregator_t *agg)
+{
+    return index_build(agg, agg->index_cap ? agg->index_cap * 2 : 256);
+}
+
+/*forget the hosts that have been silent for longer than expire_ms*/
+static void hosts_expire(aggregator_t *agg, const struct timespec *mono)
+{
+    long age;
+    int n = agg->n_hosts;
+    if (agg->expire_ms <= 0)
+        return;
+    for (int i = 0; i < agg->n_hosts;)
+    {
+        agg_host_t *host = &agg->hosts[i];
+        age = (mono->tv_sec - host->last_seen.tv_sec) * 1000 + (mono->tv_nsec - host->last_seen.tv_nsec) / 1000000;
+        if (age <= agg->expire_ms)
+        {
+            i++;
+            continue;
+        }
+        M_LOG(MODULE_NAME, "Aggregator: host %s expired after %ld ms", host->name, age);
+        if (host->record)
+            free(host->record);
+        // the last host takes the free slot, the index is rebuilt below
+        *host = agg->hosts[--agg->n_hosts];
+    }
+    if (agg->n_hosts != n && index_build(agg, agg->index_cap) == -1)
+        M_ERROR(MODULE_NAME, "Aggregator: unable to rebuild the host index");
+}
+
+static agg_host_t *host_get(aggregator_t *agg, const char *name)
+{
+    uint32_t slot;
+    agg_host_t *host;
+    if (agg->index_cap == 0 || (agg->n_hosts + 1) * 2 > agg->index_cap)
+    {
+        if (index_grow(agg) == -1)
+            return NULL;
+    }
+    slot = hash_name(name) & (agg->index_cap - 1);
+    while (agg->index[slot] != -1)
+    {
+        host = &agg->hosts[agg->index[slot]];
+        if (strcmp(host->name, name) == 0)
+            return host;
+        slot = (slot + 1) & (agg->index_cap - 1);
+    }
+    if (agg->n_hosts == agg->hosts_cap)
+    {
+        int cap = agg->hosts_cap ? agg->hosts_cap * 2 : 64;
+        host = (agg_host_t *)realloc(agg->hosts, cap * sizeof(agg_host_t));
+        if (!host)
+            return NULL;
+        agg->hosts = host;
+        agg->hosts_cap = cap;
+    }
+    host = &agg->hosts[agg->n_hosts];
+    (void)memset(host, 0, sizeof(*host));
+    (void)memcpy(host->name, name, strnlen(name, sizeof(host->name) - 1));
+    agg->index[slot] = agg->n_hosts++;
+    M_LOG(MODULE_NAME, "Aggregator: new host %s", host->name);
+    return host;
+}
+
+static void handle_record(aggregator_t *agg, agg_conn_t *conn, const char *line, size_t len)
+{
+    agg_fields_t fields;
+    agg_host_t *host;
+    if (len == 0)
+        return;
+    if (scan_record(line, len, &fields) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Aggregator: malformed record from %s, dropped", conn->peer);
+        return;
+    }
+    if (fields.is_event)
+    {
+        // events are forwarded as they come
+        obuf_reset(&agg->event);
+        obuf_put(&agg->event, line, len);
+        obuf_putc(&agg->event, '\n');
+        if (agg->emit && !agg->event.error)
+            agg->emit(agg->user, &agg->event);
+        return;
+    }
+    host = host_get(agg, fields.host[0] != '\0' ? fields.host : conn->peer);
+    if (!host)
+    {
+        M_ERROR(MODULE_NAME, "Aggregator: unable to allocate host entry");
+        return;
+    }
+    if (len > host->cap)
+    {
+        char *ptr = (char *)realloc(host->record, len);
+        if (!ptr)
+            return;
+        host->record = ptr;
+        host->cap = len;
+    }
+    (void)memcpy(host->record, line, len);
+    host->len = len;
+    (void)memcpy(host->values, fields.values, sizeof(fields.values));
+    clock_gettime(CLOCK_MONOTONIC, &host->last_seen);
+    host->n_records++;
+}
+
+static void conn_close(aggregator_t *agg, agg_conn_t *conn)
+{
+    (void)epoll_ctl(agg->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    (void)close(conn->fd);
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        agg->conns = conn->next;
+    if (conn->next)
+        conn->next->prev = conn->prev;
+    if (conn->rbuf)
+        free(conn->rbuf);
+    free(conn);
+    agg->n_conns--;
+}
+
+/*return -1 when the connection is closed*/
+static int conn_read(aggregator_t *agg, agg_conn_t *conn)
+{
+    ssize_t ret;
+    char *line, *nl;
+    while (1)
+    {
+        if (conn->rcap - conn->rlen < AGG_READ_CHUNK)
+        {
+            size_t cap = conn->rcap ? conn->rcap * 2 : AGG_READ_CHUNK * 2;
+            char *ptr;
+            if (cap > AGG_MAX_LINE)
+            {
+                M_ERROR(MODULE_NAME, "Aggregator: record from %s is too long, drop connection", conn->peer);
+                return -1;
+            }
+            ptr = (char *)realloc(conn->rbuf, cap);
+            if (!ptr)
+                return -1;
+            conn->rbuf = ptr;
+            conn->rcap = cap;
+        }
+        ret = read(conn->fd, conn->rbuf + conn->rlen, conn->rcap - conn->rlen);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        if (ret == 0)
+            return -1;
+        conn->rlen += (size_t)ret;
+        line = conn->rbuf;
+        while ((nl = memchr(line, '\n', conn->rbuf + conn->rlen - line)) != NULL)
+        {
+            handle_record(agg, conn, line, (size_t)(nl - line));
+            line = nl + 1;
+        }
+        conn->rlen -= (size_t)(line - conn->rbuf);
+        if (conn->rlen > 0 && line != conn->rbuf)
+            (void)memmove(conn->rbuf, line, conn->rlen);
+    }
+}
+
+static void conn_accept(aggregator_t *agg)
+{
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    struct epoll_event ev;
+    agg_conn_t *conn;
+    int fd;
+    while (1)
+    {
+        addr_len = sizeof(addr);
+        fd = accept4(agg->listen_fd, (struct sockaddr *)&addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                M_ERROR(MODULE_NAME, "Aggregator: unable to accept: %s", strerror(errno));
+            return;
+        }
+        conn = (agg_conn_t *)calloc(1, sizeof(agg_conn_t));
+        if (!conn)
+        {
+            (void)close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        // peer name is the host key of agents that do not set host_name,
+        // it must not change when the agent reconnects (no port, no pid)
+        if (addr.ss_family == AF_INET || addr.ss_family == AF_INET6)
+        {
+            char ip[INET6_ADDRSTRLEN];
+            if (addr.ss_family == AF_INET)
+                (void)inet_ntop(AF_INET, &((struct sockaddr_in *)&addr)->sin_addr, ip, sizeof(ip));
+            else
+                (void)inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&addr)->sin6_addr, ip, sizeof(ip));
+            (void)snprintf(conn->peer, sizeof(conn->peer), "%s", ip);
+        }
+        else
+        {
+            struct ucred cred;
+            socklen_t cred_len = sizeof(cred);
+            if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0)
+                (void)snprintf(conn->peer, sizeof(conn->peer), "local:uid%d", (int)cred.uid);
+            else
+                (void)snprintf(conn->peer, sizeof(conn->peer), "local");
+        }
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = conn;
+        if (epoll_ctl(agg->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Aggregator: unable to watch %s: %s", conn->peer, strerror(errno));
+            (void)close(fd);
+            free(conn);
+            continue;
+        }
+        conn->next = agg->conns;
+        if (agg->conns)
+            agg->conns->prev = conn;
+        agg->conns = conn;
+        agg->n_conns++;
+    }
+}
+
+static int open_listen(aggregator_t *agg)
+{
+    int fd = -1, on = 1;
+    if (strncmp(agg->listen, "unix:", 5) == 0)
+    {
+        struct sockaddr_un address;
+        (void)memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        (void)strncpy(address.sun_path, agg->listen + 5, sizeof(address.sun_path) - 1);
+        (void)unlink(address.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+            goto error;
+    }
+    else if (strncmp(agg->listen, "tcp:", 4) == 0)
+    {
+        char host[MAX_BUF];
+        char *port;
+        struct addrinfo hints, *res = NULL;
+        (void)strncpy(host, agg->listen + 4, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+        port = strrchr(host, ':');
+        if (port == NULL)
+            goto error;
+        *port++ = '\0';
+        (void)memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        if (getaddrinfo(host[0] ? host : NULL, port, &hints, &res) != 0 || res == NULL)
+            goto error;
+        fd = socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd != -1)
+            (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (fd == -1 || bind(fd, res->ai_addr, res->ai_addrlen) == -1)
+        {
+            freeaddrinfo(res);
+            goto error;
+        }
+        freeaddrinfo(res);
+    }
+    else
+    {
+        M_ERROR(MODULE_NAME, "Aggregator: invalid listen address %s", agg->listen);
+        return -1;
+    }
+    if (listen(fd, SOMAXCONN) == -1)
+        goto error;
+    agg->listen_fd = fd;
+    M_LOG(MODULE_NAME, "Aggregator: listening on %s", agg->listen);
+    return 0;
+error:
+    M_ERROR(MODULE_NAME, "Aggregator: unable to listen on %s: %s", agg->listen, strerror(errno));
+    if (fd != -1)
+        (void)close(fd);
+    return -1;
+}
+
+static void publish(aggregator_t *agg)
+{
+    struct timeval now;
+    struct timespec mono;
+    obuf_t *ob = &agg->out;
+    double min[AGG_N_KEYS], max[AGG_N_KEYS], sum[AGG_N_KEYS];
+    int count[AGG_N_KEYS];
+    int n_stale = 0;
+    long age;
+    agg_host_t *host;
+    gettimeofday(&now, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    hosts_expire(agg, &mono);
+    for (int k = 0; k < AGG_N_KEYS; k++)
+    {
+        min[k] = INFINITY;
+        max[k] = -INFINITY;
+        sum[k] = 0.0;
+        count[k] = 0;
+    }
+    obuf_reset(ob);
+    OBUF_LIT(ob, "{\"stamp_sec\": ");
+    obuf_u64(ob, (uint64_t)now.tv_sec);
+    OBUF_LIT(ob, ",\"stamp_usec\": ");
+    obuf_u64(ob, (uint64_t)now.tv_usec);
+    OBUF_LIT(ob, ",\"hosts\":[");
+    for (int i = 0; i < agg->n_hosts; i++)
+    {
+        host = &agg->hosts[i];
+        age = (mono.tv_sec - host->last_seen.tv_sec) * 1000 + (mono.tv_nsec - host->last_seen.tv_nsec) / 1000000;
+        if (i > 0)
+            obuf_putc(ob, ',');
+        OBUF_LIT(ob, "{\"host\":\"");
+        obuf_puts(ob, host->name);
+        OBUF_LIT(ob, "\",\"age_ms\": ");
+        obuf_i64(ob, age);
+        if (age > agg->stale_ms)
+        {
+            // stale hosts are listed but left out of the rollups
+            n_stale++;
+            OBUF_LIT(ob, ",\"stale\": 1");
+        }
+        else
+        {
+            OBUF_LIT(ob, ",\"stale\": 0");
+            for (int k = 0; k < AGG_N_KEYS; k++)
+            {
+                double value = host->values[k];
+                if (isnan(value))
+                    continue;
+                if (value < min[k])
+                    min[k] = value;
+                if (value > max[k])
+                    max[k] = value;
+                sum[k] += value;
+                count[k]++;
+            }
+        }
+        OBUF_LIT(ob, ",\"data\":");
+        if (host->len > 0)
+            obuf_put(ob, host->record, host->len);
+        else
+            OBUF_LIT(ob, "null");
+        obuf_putc(ob, '}');
+    }
+    OBUF_LIT(ob, "],\"fleet\":{\"hosts\": ");
+    obuf_i64(ob, agg->n_hosts);
+    OBUF_LIT(ob, ",\"stale\": ");
+    obuf_i64(ob, n_stale);
+    OBUF_LIT(ob, ",\"agents\": ");
+    obuf_i64(ob, agg->n_conns);
+    for (int k = 0; k < AGG_N_KEYS; k++)
+    {
+        if (count[k] == 0)
+            continue;
+        OBUF_LIT(ob, ",\"");
+        obuf_puts(ob, agg_names[k]);
+        OBUF_LIT(ob, "\":{\"min\": ");
+        obuf_fixed(ob, min[k], 3);
+        OBUF_LIT(ob, ",\"max\": ");
+        obuf_fixed(ob, max[k], 3);
+        OBUF_LIT(ob, ",\"avg\": ");
+        obuf_fixed(ob, sum[k] / count[k], 3);
+        obuf_putc(ob, '}');
+    }
+    OBUF_LIT(ob, "}}\n");
+    if (agg->emit && !ob->error)
+        agg->emit(agg->user, ob);
+}
+
+void aggregator_init(aggregator_t *agg)
+{
+    (void)memset(agg, 0, sizeof(*agg));
+    agg->listen_fd = -1;
+    agg->epoll_fd = -1;
+    agg->timer_fd = -1;
+    agg->stale_ms = 5000;
+    agg->expire_ms = 300000;
+    obuf_init(&agg->out);
+    obuf_init(&agg->event);
+}
+
+/**
+ * Serve agent streams until running is cleared, publishing the fleet
+ * record once per period. Agent records are new line separated JSON
+ * records, as written by sysmond to a sock: or tcp: output
+ */
+int aggregator_run(aggregator_t *agg, const struct itimerspec *period, volatile int *running)
+{
+    struct epoll_event ev, events[AGG_MAX_EVENTS];
+    uint64_t expirations;
+    int n;
+    if (open_listen(agg) == -1)
+        return -1;
+    agg->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    agg->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (agg->epoll_fd == -1 || agg->timer_fd == -1 || timerfd_settime(agg->timer_fd, 0, period, NULL) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Aggregator: unable to init event loop: %s", strerror(errno));
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &agg->listen_fd;
+    (void)epoll_ctl(agg->epoll_fd, EPOLL_CTL_ADD, agg->listen_fd, &ev);
+    ev.data.ptr = &agg->timer_fd;
+    (void)epoll_ctl(agg->epoll_fd, EPOLL_CTL_ADD, agg->timer_fd, &ev);
+    while (*running)
+    {
+        n = epoll_wait(agg->epoll_fd, events, AGG_MAX_EVENTS, -1);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            M_ERROR(MODULE_NAME, "Aggregator: epoll_wait: %s", strerror(errno));
+            return -1;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == &agg->listen_fd)
+            {
+                conn_accept(agg);
+            }
+            else if (events[i].data.ptr == &agg->timer_fd)
+            {
+                if (read(agg->timer_fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations))
+                    publish(agg);
+            }
+            else
+            {
+                agg_conn_t *conn = (agg_conn_t *)events[i].data.ptr;
+                // drain what is left before handling a hang up
+                if (conn_read(agg, conn) == -1)
+                    conn_close(agg, conn);
+            }
+        }
+    }
+    return 0;
+}
+
+void aggregator_release(aggregator_t *agg)
+{
+    while (agg->conns)
+    {
+        conn_close(agg, agg->conns);
+    }
+    if (agg->listen_fd >= 0)
+    {
+        (void)close(agg->listen_fd);
+        if (strncmp(agg->listen, "unix:", 5) == 0)
+            (void)unlink(agg->listen + 5);
+    }
+    if (agg->epoll_fd >= 0)
+        (void)close(agg->epoll_fd);
+    if (agg->timer_fd >= 0)
+        (void)close(agg->timer_fd);
+    for (int i = 0; i < agg->n_hosts; i++)
+    {
+        if (agg->hosts[i].record)
+            free(agg->hosts[i].record);
+    }
+    if (agg->hosts)
+        free(agg->hosts);
+    if (agg->index)
+        free(agg->index);
+    obuf_free(&agg->out);
+    obuf_free(&agg->event);
+    agg->hosts = NULL;
+    agg->index = NULL;
+}
@@ -0,0 +1,75 @@
+#ifndef AGGREGATOR_H
+#define AGGREGATOR_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+
+/*top level record fields rolled up over the fleet*/
+typedef enum
+{
+    AGG_CPU_USAGE = 0,
+    AGG_CPU_TEMP,
+    AGG_MEM_AVAILABLE,
+    AGG_MEM_USED,
+    AGG_DISK_FREE,
+    AGG_BATTERY_PERCENT,
+    AGG_N_KEYS
+} agg_key_t;
+
+typedef struct agg_conn
+{
+    int fd;
+    char peer[64];
+    struct agg_conn *prev;
+    struct agg_conn *next;
+    char *rbuf;
+    size_t rlen;
+    size_t rcap;
+} agg_conn_t;
+
+typedef struct
+{
+    char name[64];
+    /*latest record of the host, without the trailing new line*/
+    char *record;
+    size_t len;
+    size_t cap;
+    double values[AGG_N_KEYS];
+    struct timespec last_seen;
+    uint64_t n_records;
+} agg_host_t;
+
+/*publish an encoded fleet record or a forwarded event*/
+typedef void (*agg_emit_t)(void *user, obuf_t *record);
+
+typedef struct
+{
+    char listen[MAX_BUF];
+    int stale_ms;
+    /*hosts silent for longer than this are forgotten, 0 keeps them*/
+    int expire_ms;
+    int listen_fd;
+    int epoll_fd;
+    int timer_fd;
+    int n_conns;
+    agg_conn_t *conns;
+    agg_host_t *hosts;
+    int n_hosts;
+    int hosts_cap;
+    /*open addressing index of hosts by name*/
+    int *index;
+    int index_cap;
+    obuf_t out;
+    obuf_t event;
+    agg_emit_t emit;
+    void *user;
+} aggregator_t;
+
+void aggregator_init(aggregator_t *agg);
+int aggregator_run(aggregator_t *agg, const struct itimerspec *period, volatile int *running);
+void aggregator_release(aggregator_t *agg);
+
+#endif
@@ -0,0 +1,342 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <math.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "alert.h"
+#include "metrics.h"
+
+#define SPEC_DELIM " \t"
+
+static char *trim(char *str)
+{
+    char *end;
+    while (*str == ' ' || *str == '\t')
+        str++;
+    end = str + strlen(str);
+    while (end > str && (end[-1] == ' ' || end[-1] == '\t'))
+        *--end = '\0';
+    return str;
+}
+
+static int parse_op(const char *tok, alert_op_t *op)
+{
+    if (strcmp(tok, ">") == 0)
+        *op = ALERT_OP_GT;
+    else if (strcmp(tok, ">=") == 0)
+        *op = ALERT_OP_GE;
+    else if (strcmp(tok, "<") == 0)
+        *op = ALERT_OP_LT;
+    else if (strcmp(tok, "<=") == 0)
+        *op = ALERT_OP_LE;
+    else
+        return -1;
+    return 0;
+}
+
+static int parse_action(alert_action_t *action, char *spec)
+{
+    char *save = NULL;
+    char *tok;
+    int argc = 0;
+    spec = trim(spec);
+    if (strcmp(spec, "event") == 0)
+    {
+        action->type = ALERT_ACT_EVENT;
+        return 0;
+    }
+    if (strncmp(spec, "fifo:", 5) == 0)
+    {
+        action->type = ALERT_ACT_FIFO;
+        (void)strncpy(action->arg, trim(spec + 5), MAX_BUF - 1);
+        return action->arg[0] == '\0' ? -1 : 0;
+    }
+    if (strncmp(spec, "exec:", 5) == 0)
+    {
+        // no shell involved: the command line is split on blanks once here
+        action->type = ALERT_ACT_EXEC;
+        (void)strncpy(action->arg, spec + 5, MAX_BUF - 1);
+        tok = strtok_r(action->arg, SPEC_DELIM, &save);
+        while (tok != NULL && argc < MAX_ALERT_ARGS - 1)
+        {
+            action->argv[argc++] = tok;
+            tok = strtok_r(NULL, SPEC_DELIM, &save);
+        }
+        action->argv[argc] = NULL;
+        return argc == 0 ? -1 : 0;
+    }
+    return -1;
+}
+
+void alert_init(alert_t *alert)
+{
+    (void)memset(alert, 0, sizeof(*alert));
+    obuf_init(&alert->event);
+}
+
+/**
+ * Compile a rule of the form:
+ * [name:] metric op value[%] [for n] [clear value] [cooldown sec] => action[, action...]
+ * where action is one of: event, fifo:/path/to/fifo, exec:/path/to/cmd [args...]
+ */
+int alert_add(alert_t *alert, const char *spec)
+{
+    char tmp[512];
+    char *cond, *actions, *tok, *save = NULL, *end = NULL;
+    alert_rule_t *rule;
+    int pct;
+    if (alert->n_rules >= MAX_ALERT_RULES)
+    {
+        M_ERROR(MODULE_NAME, "Too many alert rules, ignore: %s", spec);
+        return -1;
+    }
+    rule = &alert->rules[alert->n_rules];
+    (void)memset(rule, 0, sizeof(*rule));
+    (void)strncpy(tmp, spec, sizeof(tmp) - 1);
+    tmp[sizeof(tmp) - 1] = '\0';
+    actions = strstr(tmp, "=>");
+    if (actions == NULL)
+        goto error;
+    *actions = '\0';
+    actions += 2;
+    cond = tmp;
+    tok = strchr(cond, ':');
+    if (tok != NULL)
+    {
+        *tok = '\0';
+        (void)strncpy(rule->name, trim(cond), sizeof(rule->name) - 1);
+        cond = tok + 1;
+    }
+    else
+    {
+        (void)snprintf(rule->name, sizeof(rule->name), "alert%d", alert->n_rules);
+    }
+    // metric op value
+    tok = strtok_r(cond, SPEC_DELIM, &save);
+    if (tok == NULL || (rule->metric = metric_lookup(tok)) < 0)
+        goto error;
+    tok = strtok_r(NULL, SPEC_DELIM, &save);
+    if (tok == NULL || parse_op(tok, &rule->op) == -1)
+        goto error;
+    tok = strtok_r(NULL, SPEC_DELIM, &save);
+    if (tok == NULL)
+        goto error;
+    rule->threshold = strtod(tok, &end);
+    pct = (end != NULL && *end == '%');
+    rule->ref = -1;
+    if (pct)
+    {
+        rule->ref = metric_ref(rule->metric);
+        if (rule->ref < 0)
+        {
+            M_ERROR(MODULE_NAME, "Percent threshold is not supported on %s", metric_name(rule->metric));
+            goto error;
+        }
+    }
+    rule->clear = rule->threshold;
+    rule->for_samples = 1;
+    // options
+    while ((tok = strtok_r(NULL, SPEC_DELIM, &save)) != NULL)
+    {
+        char *arg;
+        // "for 5 samples" reads better than "for 5"
+        if (strcmp(tok, "samples") == 0)
+            continue;
+        arg = strtok_r(NULL, SPEC_DELIM, &save);
+        if (arg == NULL)
+            goto error;
+        if (strcmp(tok, "for") == 0)
+            rule->for_samples = atoi(arg);
+        else if (strcmp(tok, "clear") == 0)
+            rule->clear = strtod(arg, NULL);
+        else if (strcmp(tok, "cooldown") == 0)
+            rule->cooldown = atoi(arg);
+        else
+            goto error;
+    }
+    if (rule->for_samples < 1)
+        rule->for_samples = 1;
+    // actions
+    save = NULL;
+    tok = strtok_r(actions, ",", &save);
+    while (tok != NULL && rule->n_actions < MAX_ALERT_ACTIONS)
+    {
+        if (parse_action(&rule->actions[rule->n_actions], tok) == -1)
+            goto error;
+        rule->n_actions++;
+        tok = strtok_r(NULL, ",", &save);
+    }
+    if (rule->n_actions == 0)
+        goto error;
+    alert->n_rules++;
+    M_LOG(MODULE_NAME, "Alert rule %s: %s", rule->name, spec);
+    return 0;
+error:
+    M_ERROR(MODULE_NAME, "Invalid alert rule: %s", spec);
+    return -1;
+}
+
+static int check(alert_op_t op, double value, double threshold)
+{
+    switch (op)
+    {
+    case ALERT_OP_GT:
+        return value > threshold;
+    case ALERT_OP_GE:
+        return value >= threshold;
+    case ALERT_OP_LT:
+        return value < threshold;
+    case ALERT_OP_LE:
+        return value <= threshold;
+    default:
+        return 0;
+    }
+}
+
+static void encode_event(obuf_t *ob, alert_rule_t *rule, double value, int state)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    obuf_reset(ob);
+    OBUF_LIT(ob, "{\"stamp_sec\": ");
+    obuf_u64(ob, (uint64_t)now.tv_sec);
+    OBUF_LIT(ob, ",\"stamp_usec\": ");
+    obuf_u64(ob, (uint64_t)now.tv_usec);
+    OBUF_LIT(ob, ",\"event\":\"alert\",\"name\":\"");
+    obuf_puts(ob, rule->name);
+    if (state)
+        OBUF_LIT(ob, "\",\"state\":\"fired\",\"metric\":\"");
+    else
+        OBUF_LIT(ob, "\",\"state\":\"cleared\",\"metric\":\"");
+    obuf_puts(ob, metric_name(rule->metric));
+    OBUF_LIT(ob, "\",\"value\": ");
+    obuf_fixed(ob, value, 3);
+    OBUF_LIT(ob, ",\"threshold\": ");
+    obuf_fixed(ob, state ? rule->threshold : rule->clear, 3);
+    OBUF_LIT(ob, "}\n");
+}
+
+static void run_command(alert_t *alert, alert_action_t *action)
+{
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to fork %s: %s", action->argv[0], strerror(errno));
+        return;
+    }
+    if (pid == 0)
+    {
+        (void)signal(SIGPIPE, SIG_DFL);
+        (void)signal(SIGINT, SIG_DFL);
+        (void)signal(SIGTERM, SIG_DFL);
+        execvp(action->argv[0], action->argv);
+        _exit(127);
+    }
+    alert->n_children++;
+}
+
+static void write_fifo(alert_t *alert, alert_action_t *action)
+{
+    int fd = open(action->arg, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open alert fifo %s: %s", action->arg, strerror(errno));
+        return;
+    }
+    (void)guard_write(fd, alert->event.data, alert->event.len);
+    (void)close(fd);
+}
+
+static void fire(alert_t *alert, alert_rule_t *rule, double value, int state)
+{
+    M_LOG(MODULE_NAME, "Alert %s %s: %s = %.3f", rule->name, state ? "fired" : "cleared",
+          metric_name(rule->metric), value);
+    encode_event(&alert->event, rule, value, state);
+    for (int i = 0; i < rule->n_actions; i++)
+    {
+        alert_action_t *action = &rule->actions[i];
+        switch (action->type)
+        {
+        case ALERT_ACT_EVENT:
+            if (alert->emit)
+                alert->emit(alert->user, &alert->event);
+            break;
+        case ALERT_ACT_FIFO:
+            write_fifo(alert, action);
+            break;
+        case ALERT_ACT_EXEC:
+            if (state)
+                run_command(alert, action);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void alert_eval(alert_t *alert, const double *values)
+{
+    alert_rule_t *rule;
+    double value, ref;
+    struct timespec now;
+    while (alert->n_children > 0 && waitpid(-1, NULL, WNOHANG) > 0)
+    {
+        alert->n_children--;
+    }
+    for (int i = 0; i < alert->n_rules; i++)
+    {
+        rule = &alert->rules[i];
+        value = values[rule->metric];
+        // the metric is not available on this sample
+        if (isnan(value))
+            continue;
+        if (rule->ref >= 0)
+        {
+            ref = values[rule->ref];
+            if (!(ref > 0.0))
+                continue;
+            value = value * 100.0 / ref;
+        }
+        if (rule->active)
+        {
+            if (!check(rule->op, value, rule->clear))
+            {
+                rule->active = 0;
+                rule->count = 0;
+                fire(alert, rule, value, 0);
+            }
+            continue;
+        }
+        if (!check(rule->op, value, rule->threshold))
+        {
+            rule->count = 0;
+            continue;
+        }
+        if (rule->count < rule->for_samples)
+            rule->count++;
+        if (rule->count < rule->for_samples)
+        {
+            M_LOG(MODULE_NAME, "Alert %s pending, will fire after %d sample(s)", rule->name,
+                  rule->for_samples - rule->count);
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (rule->fired && rule->cooldown > 0 && now.tv_sec - rule->last_fire.tv_sec < rule->cooldown)
+            continue;
+        rule->active = 1;
+        rule->fired = 1;
+        rule->last_fire = now;
+        fire(alert, rule, value, 1);
+    }
+}
+
+void alert_release(alert_t *alert)
+{
+    obuf_free(&alert->event);
+}
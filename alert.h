@@ -0,0 +1,75 @@
+#ifndef ALERT_H
+#define ALERT_H
+
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+
+#define MAX_ALERT_RULES 32
+#define MAX_ALERT_ACTIONS 4
+#define MAX_ALERT_ARGS 16
+
+typedef enum
+{
+    ALERT_OP_GT = 0,
+    ALERT_OP_GE,
+    ALERT_OP_LT,
+    ALERT_OP_LE
+} alert_op_t;
+
+typedef enum
+{
+    ALERT_ACT_EVENT = 0,
+    ALERT_ACT_FIFO,
+    ALERT_ACT_EXEC
+} alert_action_type_t;
+
+typedef struct
+{
+    alert_action_type_t type;
+    /*fifo path, or the command line split in place into argv*/
+    char arg[MAX_BUF];
+    char *argv[MAX_ALERT_ARGS];
+} alert_action_t;
+
+typedef struct
+{
+    char name[32];
+    int metric;
+    /*percent thresholds are relative to this metric, -1 for absolute values*/
+    int ref;
+    alert_op_t op;
+    double threshold;
+    /*hysteresis: an active rule is cleared when the value no longer satisfies clear*/
+    double clear;
+    int for_samples;
+    int cooldown;
+    int n_actions;
+    alert_action_t actions[MAX_ALERT_ACTIONS];
+    /*runtime state*/
+    int count;
+    int active;
+    int fired;
+    struct timespec last_fire;
+} alert_rule_t;
+
+/*emit an encoded event record to the data output*/
+typedef void (*alert_emit_t)(void *user, obuf_t *event);
+
+typedef struct
+{
+    int n_rules;
+    alert_rule_t rules[MAX_ALERT_RULES];
+    int n_children;
+    obuf_t event;
+    alert_emit_t emit;
+    void *user;
+} alert_t;
+
+void alert_init(alert_t *alert);
+int alert_add(alert_t *alert, const char *spec);
+void alert_eval(alert_t *alert, const double *values);
+void alert_release(alert_t *alert);
+
+#endif
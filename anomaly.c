@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "anomaly.h"
+
+/*deviation floor relative to the mean: a flat signal does not turn every small step into an anomaly*/
+#define ANOMALY_MIN_STD 1e-3
+/*absolute floor, in the unit of the metric: a flat zero baseline still scores its first burst*/
+#define ANOMALY_ABS_STD 1.0
+
+void anomaly_init(anomaly_t *an)
+{
+    (void)memset(an, 0, sizeof(*an));
+    an->alpha = 0.05;
+    an->threshold = 4.0;
+    an->warmup = 30;
+    an->season = 0;
+    an->n_slots = 24;
+    an->season_weight = 0.3;
+    for (int i = 0; i < METRIC_COUNT; i++)
+        an->min_std[i] = ANOMALY_ABS_STD;
+    tzset();
+    an->utc_offset = -timezone;
+    obuf_init(&an->event);
+}
+
+int anomaly_config(anomaly_t *an, const char *name, const char *value)
+{
+    char token[64];
+    size_t len;
+    int id;
+    if (EQU(name, "anomaly_metrics"))
+    {
+        an->n_metrics = 0;
+        // tokenized in place, the list is not bounded by a copy
+        for (value += strspn(value, ", "); *value != '\0'; value += strspn(value, ", "))
+        {
+            len = strcspn(value, ", ");
+            (void)snprintf(token, sizeof(token), "%.*s", (int)len, value);
+            value += len;
+            if (an->n_metrics == METRIC_COUNT)
+            {
+                M_ERROR(MODULE_NAME, "Anomaly detection: more than %d metrics, %s and the next ones are ignored",
+                        METRIC_COUNT, token);
+                break;
+            }
+            id = metric_lookup(token);
+            if (id == -1)
+            {
+                M_ERROR(MODULE_NAME, "Anomaly detection: unknown metric %s", token);
+                continue;
+            }
+            (void)memset(&an->metrics[an->n_metrics], 0, sizeof(anomaly_metric_t));
+            an->metrics[an->n_metrics].metric = id;
+            an->metrics[an->n_metrics].slot = -1;
+            an->n_metrics++;
+        }
+    }
+    else if (EQU(name, "anomaly_min_std"))
+    {
+        // <std> for every metric, or <metric>:<std>
+        for (value += strspn(value, ", "); *value != '\0'; value += strspn(value, ", "))
+        {
+            char *sep;
+            double std;
+            len = strcspn(value, ", ");
+            (void)snprintf(token, sizeof(token), "%.*s", (int)len, value);
+            value += len;
+            sep = strchr(token, ':');
+            std = atof(sep ? sep + 1 : token);
+            if (std <= 0.0)
+            {
+                M_ERROR(MODULE_NAME, "Anomaly detection: invalid deviation floor %s", token);
+                continue;
+            }
+            if (!sep)
+            {
+                for (int i = 0; i < METRIC_COUNT; i++)
+                    an->min_std[i] = std;
+                continue;
+            }
+            *sep = '\0';
+            id = metric_lookup(token);
+            if (id == -1)
+            {
+                M_ERROR(MODULE_NAME, "Anomaly detection: unknown metric %s", token);
+                continue;
+            }
+            an->min_std[id] = std;
+        }
+    }
+    else if (EQU(name, "anomaly_alpha"))
+    {
+        an->alpha = atof(value);
+        if (an->alpha <= 0.0 || an->alpha >= 1.0)
+            an->alpha = 0.05;
+    }
+    else if (EQU(name, "anomaly_threshold"))
+    {
+        an->threshold = atof(value);
+    }
+    else if (EQU(name, "anomaly_warmup"))
+    {
+        an->warmup = atoi(value);
+    }
+    else if (EQU(name, "anomaly_season"))
+    {
+        an->season = atoi(value);
+    }
+    else if (EQU(name, "anomaly_season_slots"))
+    {
+        an->n_slots = atoi(value);
+        if (an->n_slots < 1)
+            an->n_slots = 1;
+        if (an->n_slots > ANOMALY_MAX_SLOTS)
+            an->n_slots = ANOMALY_MAX_SLOTS;
+    }
+    else if (EQU(name, "anomaly_season_weight"))
+    {
+        an->season_weight = atof(value);
+        if (an->season_weight <= 0.0 || an->season_weight > 1.0)
+            an->season_weight = 0.3;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static double zscore(double value, double mean, double var, double min_std)
+{
+    double std = sqrt(var);
+    double floor = fabs(mean) * ANOMALY_MIN_STD;
+    if (floor < min_std)
+        floor = min_std;
+    if (std < floor)
+        std = floor;
+    if (std <= 0.0)
+        return 0.0;
+    return (value - mean) / std;
+}
+
+/*fold the finished visit of a slot into its baseline, across the periods*/
+static void slot_fold(anomaly_t *an, anomaly_metric_t *m)
+{
+    anomaly_slot_t *s;
+    double mean, var, d;
+    if (m->slot < 0 || m->slot_n == 0)
+        return;
+    s = &m->slots[m->slot];
+    mean = m->slot_sum / m->slot_n;
+    var = m->slot_sq / m->slot_n - mean * mean;
+    if (var < 0.0)
+        var = 0.0;
+    if (s->visits == 0)
+    {
+        s->mean = mean;
+        s->var = var;
+    }
+    else
+    {
+        d = mean - s->mean;
+        s->mean += an->season_weight * d;
+        s->var = (1.0 - an->season_weight) * (s->var + an->season_weight * d * d) + an->season_weight * var;
+    }
+    s->visits++;
+}
+
+static void encode_event(anomaly_t *an, anomaly_metric_t *m, double value, const struct timeval *now)
+{
+    obuf_t *ob = &an->event;
+    obuf_reset(ob);
+    OBUF_LIT(ob, "{\"stamp_sec\": ");
+    obuf_u64(ob, (uint64_t)now->tv_sec);
+    OBUF_LIT(ob, ",\"stamp_usec\": ");
+    obuf_u64(ob, (uint64_t)now->tv_usec);
+    OBUF_LIT(ob, ",\"event\":\"anomaly\",\"metric\":\"");
+    obuf_puts(ob, metric_name(m->metric));
+    if (m->active)
+        OBUF_LIT(ob, "\",\"state\":\"fired\",\"value\": ");
+    else
+        OBUF_LIT(ob, "\",\"state\":\"cleared\",\"value\": ");
+    obuf_fixed(ob, value, 3);
+    OBUF_LIT(ob, ",\"mean\": ");
+    obuf_fixed(ob, m->mean, 3);
+    OBUF_LIT(ob, ",\"std\": ");
+    obuf_fixed(ob, sqrt(m->var), 3);
+    OBUF_LIT(ob, ",\"z\": ");
+    obuf_fixed(ob, m->z, 2);
+    OBUF_LIT(ob, ",\"z_season\": ");
+    if (isnan(m->z_season))
+        OBUF_LIT(ob, "null");
+    else
+        obuf_fixed(ob, m->z_season, 2);
+    OBUF_LIT(ob, "}\n");
+}
+
+void anomaly_eval(anomaly_t *an, const double *values, const struct timeval *now)
+{
+    int slot = -1;
+    if (an->n_metrics == 0)
+        return;
+    if (an->season > 0)
+    {
+        // slots follow the local standard time, e.g. the same hour every day
+        long long t = (long long)now->tv_sec + an->utc_offset;
+        slot = (int)((t % an->season) * an->n_slots / an->season);
+    }
+    an->n_active = 0;
+    for (int i = 0; i < an->n_metrics; i++)
+    {
+        anomaly_metric_t *m = &an->metrics[i];
+        double x = values[m->metric], diff, incr, limit;
+        int anomalous, state = m->active;
+        if (isnan(x))
+        {
+            an->n_active += m->active;
+            continue;
+        }
+        if (slot != m->slot)
+        {
+            slot_fold(an, m);
+            m->slot = slot;
+            m->slot_sum = 0.0;
+            m->slot_sq = 0.0;
+            m->slot_n = 0;
+        }
+        // scores against the baselines before this sample is part of them
+        m->z = m->n >= (uint64_t)an->warmup ? zscore(x, m->mean, m->var, an->min_std[m->metric]) : 0.0;
+        m->z_season = NAN;
+        if (slot >= 0 && m->slots[slot].visits > 0)
+            m->z_season = zscore(x, m->slots[slot].mean, m->slots[slot].var, an->min_std[m->metric]);
+        // an active anomaly clears at half the threshold, a level expected at this time is not one
+        limit = m->active ? an->threshold / 2 : an->threshold;
+        anomalous = fabs(m->z) > limit && (isnan(m->z_season) || fabs(m->z_season) > limit);
+        m->active = anomalous;
+        an->n_active += anomalous;
+        if (m->n == 0)
+        {
+            m->mean = x;
+            m->var = 0.0;
+        }
+        else
+        {
+            diff = x - m->mean;
+            incr = an->alpha * diff;
+            m->mean += incr;
+            m->var = (1.0 - an->alpha) * (m->var + diff * incr);
+        }
+        m->n++;
+        m->slot_sum += x;
+        m->slot_sq += x * x;
+        m->slot_n++;
+        if (state != m->active)
+        {
+            M_LOG(MODULE_NAME, "Anomaly %s on %s: %.3f (z %.2f)", m->active ? "fired" : "cleared",
+                  metric_name(m->metric), x, m->z);
+            encode_event(an, m, x, now);
+            if (an->emit && !an->event.error)
+                an->emit(an->user, &an->event);
+        }
+    }
+}
+
+void anomaly_encode(anomaly_t *an, obuf_t *ob)
+{
+    int first = 1;
+    if (an->n_active == 0)
+        return;
+    OBUF_LIT(ob, ",\"anomalies\":{");
+    for (int i = 0; i < an->n_metrics; i++)
+    {
+        if (!an->metrics[i].active)
+            continue;
+        if (!first)
+            obuf_putc(ob, ',');
+        first = 0;
+        obuf_putc(ob, '"');
+        obuf_puts(ob, metric_name(an->metrics[i].metric));
+        OBUF_LIT(ob, "\": ");
+        obuf_fixed(ob, an->metrics[i].z, 2);
+    }
+    obuf_putc(ob, '}');
+}
+
+void anomaly_release(anomaly_t *an)
+{
+    obuf_free(&an->event);
+}
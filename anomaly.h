@@ -0,0 +1,69 @@
+#ifndef ANOMALY_H
+#define ANOMALY_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "metrics.h"
+
+/*15 minutes slots over a day*/
+#define ANOMALY_MAX_SLOTS 96
+
+typedef struct
+{
+    double mean;
+    double var;
+    uint32_t visits;
+} anomaly_slot_t;
+
+typedef struct
+{
+    int metric;
+    /*EWMA baseline*/
+    double mean;
+    double var;
+    uint64_t n;
+    double z;
+    double z_season;
+    int active;
+    /*running sums of the current visit of a seasonal slot, folded when the slot changes*/
+    int slot;
+    double slot_sum;
+    double slot_sq;
+    uint32_t slot_n;
+    anomaly_slot_t slots[ANOMALY_MAX_SLOTS];
+} anomaly_metric_t;
+
+/*emit an encoded event record to the data output*/
+typedef void (*anomaly_emit_t)(void *user, obuf_t *event);
+
+typedef struct
+{
+    int n_metrics;
+    anomaly_metric_t metrics[METRIC_COUNT];
+    double alpha;
+    double threshold;
+    int warmup;
+    /*seasonal period in seconds (0 disables it) and its number of slots*/
+    int season;
+    int n_slots;
+    /*local standard time offset of the slots, DST changes do not move them*/
+    long utc_offset;
+    double season_weight;
+    /*absolute deviation floor of each metric, in its unit*/
+    double min_std[METRIC_COUNT];
+    int n_active;
+    obuf_t event;
+    anomaly_emit_t emit;
+    void *user;
+} anomaly_t;
+
+void anomaly_init(anomaly_t *an);
+int anomaly_config(anomaly_t *an, const char *name, const char *value);
+void anomaly_eval(anomaly_t *an, const double *values, const struct timeval *now);
+void anomaly_encode(anomaly_t *an, obuf_t *ob);
+void anomaly_release(anomaly_t *an);
+
+#endif
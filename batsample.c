@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "batsample.h"
+
+#define NSEC_PER_SEC 1000000000L
+/*sampling periods without a successful reading before the published value is stale*/
+#define BATSAMPLE_STALE_PERIODS 4
+
+float battery_map_percent(float volt, float min_voltage, float max_voltage)
+{
+    float result;
+    if (volt < min_voltage)
+        return 0.0;
+    result = 101 - (101 / pow(1 + pow(1.33 * (volt - min_voltage) / (max_voltage - min_voltage), 4.5), 3));
+    if (result > 100.0)
+        result = 100.0;
+    return result;
+}
+
+void batsample_init(batsample_t *bs)
+{
+    (void)memset(bs, 0, sizeof(*bs));
+    bs->median = 5;
+    bs->filter_hz = 1.0;
+    bs->capacity = 0.0;
+    bs->slope_window = 120;
+    pfile_init(&bs->file);
+}
+
+int batsample_config(batsample_t *bs, const char *name, const char *value)
+{
+    if (EQU(name, "battery_sample_rate"))
+    {
+        bs->rate = atoi(value);
+        if (bs->rate > 1000)
+            bs->rate = 1000;
+    }
+    else if (EQU(name, "battery_median_window"))
+    {
+        bs->median = atoi(value);
+        if (bs->median < 1)
+            bs->median = 1;
+        if (bs->median > BATSAMPLE_MAX_MEDIAN)
+            bs->median = BATSAMPLE_MAX_MEDIAN;
+    }
+    else if (EQU(name, "battery_filter_hz"))
+    {
+        bs->filter_hz = atof(value);
+    }
+    else if (EQU(name, "battery_capacity"))
+    {
+        bs->capacity = atof(value);
+    }
+    else if (EQU(name, "battery_slope_window"))
+    {
+        bs->slope_window = atoi(value);
+        if (bs->slope_window < 10)
+            bs->slope_window = 10;
+        if (bs->slope_window > BATSAMPLE_MAX_SLOPE)
+            bs->slope_window = BATSAMPLE_MAX_SLOPE;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static double elapsed(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static void publish(batsample_t *bs)
+{
+    uint32_t seq = __atomic_load_n(&bs->slot.seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&bs->slot.seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    bs->slot.value = bs->value;
+    __atomic_store_n(&bs->slot.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+int batsample_get(batsample_t *bs, batsample_value_t *value)
+{
+    uint32_t begin, end;
+    // the producer writes a few dozen bytes at most every few ms, a retry is rare
+    for (int i = 0; i < 64; i++)
+    {
+        begin = __atomic_load_n(&bs->slot.seq, __ATOMIC_ACQUIRE);
+        if (begin & 1)
+            continue;
+        *value = bs->slot.value;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&bs->slot.seq, __ATOMIC_RELAXED);
+        if (begin == end)
+            return begin == 0 ? -1 : 0;
+    }
+    return -1;
+}
+
+int batsample_stale(batsample_t *bs, const batsample_value_t *value)
+{
+    struct timespec now;
+    double limit = BATSAMPLE_STALE_PERIODS * bs->period_ns / 1e9;
+    if (value->samples == 0)
+        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return elapsed(&value->last_sample, &now) > (limit > 1.0 ? limit : 1.0);
+}
+
+static double median(batsample_t *bs)
+{
+    double sorted[BATSAMPLE_MAX_MEDIAN], v;
+    int i, j;
+    for (i = 0; i < bs->n_history; i++)
+    {
+        v = bs->history[i];
+        for (j = i; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    return sorted[bs->n_history / 2];
+}
+
+/*least squares slope of the percent over the last slope_window seconds, in %/s*/
+static double slope(batsample_t *bs)
+{
+    double st = 0.0, sp = 0.0, stt = 0.0, stp = 0.0, d;
+    int n = bs->n_slope;
+    if (n < 10)
+        return NAN;
+    for (int i = 0; i < n; i++)
+    {
+        st += bs->slope_t[i];
+        sp += bs->slope_p[i];
+        stt += bs->slope_t[i] * bs->slope_t[i];
+        stp += bs->slope_t[i] * bs->slope_p[i];
+    }
+    d = n * stt - st * st;
+    if (d <= 0.0)
+        return NAN;
+    return (n * stp - st * sp) / d;
+}
+
+static void process(batsample_t *bs, double raw, const struct timespec *now)
+{
+    batsample_value_t *v = &bs->value;
+    double m, s;
+    bs->history[bs->head] = raw;
+    bs->head = (bs->head + 1) % bs->median;
+    if (bs->n_history < bs->median)
+        bs->n_history++;
+    // the median drops the spikes, the low pass smooths the load sags
+    m = median(bs);
+    if (v->samples == 0)
+        bs->filtered = m;
+    else
+        bs->filtered += bs->alpha * (m - bs->filtered);
+    v->samples++;
+    v->last_sample = *now;
+    v->filtered = bs->filtered;
+    v->percent = battery_map_percent(bs->filtered * bs->ratio, bs->min_voltage, bs->max_voltage);
+    if (v->samples == 1 || elapsed(&bs->last_point, now) >= 1.0)
+    {
+        bs->last_point = *now;
+        bs->slope_t[bs->slope_head] = elapsed(&bs->start, now);
+        bs->slope_p[bs->slope_head] = v->percent;
+        bs->slope_head = (bs->slope_head + 1) % bs->slope_window;
+        if (bs->n_slope < bs->slope_window)
+            bs->n_slope++;
+        s = slope(bs);
+        v->slope = s * 3600.0;
+        v->current = bs->capacity > 0.0 && !isnan(s) ? -v->slope / 100.0 * bs->capacity : NAN;
+        v->time_to_empty = NAN;
+        if (s < 0.0 && v->percent > bs->empty_percent)
+            v->time_to_empty = (v->percent - bs->empty_percent) / -s;
+    }
+    publish(bs);
+}
+
+static void *sampler_main(void *data)
+{
+    batsample_t *bs = (batsample_t *)data;
+    struct timespec next, now;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    bs->start = next;
+    while (__atomic_load_n(&bs->running, __ATOMIC_ACQUIRE))
+    {
+        if (pfile_read(&bs->file, 0) > 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            process(bs, atof(bs->file.data), &now);
+        }
+        else
+        {
+            // published too, the reader sees the errors and the age of the last reading
+            bs->value.errors++;
+            publish(bs);
+        }
+        next.tv_nsec += bs->period_ns;
+        while (next.tv_nsec >= NSEC_PER_SEC)
+        {
+            next.tv_nsec -= NSEC_PER_SEC;
+            next.tv_sec++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed(&next, &now) > 0.0)
+        {
+            // late by more than a period: skip the missed ticks instead of bursting
+            bs->value.overruns++;
+            next = now;
+        }
+        (void)clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    return NULL;
+}
+
+int batsample_open(batsample_t *bs, const char *path)
+{
+    int err;
+    double dt;
+    if (bs->rate <= 0)
+        return 0;
+    if (pfile_open(&bs->file, path) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open battery input %s: %s", path, strerror(errno));
+        return -1;
+    }
+    bs->period_ns = NSEC_PER_SEC / bs->rate;
+    dt = 1.0 / bs->rate;
+    bs->alpha = bs->filter_hz > 0.0 ? 1.0 - exp(-2.0 * M_PI * bs->filter_hz * dt) : 1.0;
+    bs->running = 1;
+    err = pthread_create(&bs->thread, NULL, sampler_main, bs);
+    if (err != 0)
+    {
+        M_ERROR(MODULE_NAME, "Unable to start the battery sampler: %s", strerror(err));
+        bs->running = 0;
+        pfile_close(&bs->file);
+        return -1;
+    }
+    bs->started = 1;
+    M_LOG(MODULE_NAME, "Battery sampler: %d Hz, median of %d, low pass at %.2f Hz", bs->rate, bs->median,
+          bs->filter_hz);
+    return 0;
+}
+
+void batsample_close(batsample_t *bs)
+{
+    if (bs->started)
+    {
+        __atomic_store_n(&bs->running, 0, __ATOMIC_RELEASE);
+        (void)pthread_join(bs->thread, NULL);
+        M_LOG(MODULE_NAME, "Battery sampler: %llu samples, %llu errors, %llu overruns",
+              (unsigned long long)bs->value.samples, (unsigned long long)bs->value.errors,
+              (unsigned long long)bs->value.overruns);
+        bs->started = 0;
+    }
+    pfile_close(&bs->file);
+}
@@ -0,0 +1,84 @@
+#ifndef BATSAMPLE_H
+#define BATSAMPLE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sysmon.h"
+#include "pfile.h"
+
+#define BATSAMPLE_MAX_MEDIAN 15
+/*one point per second for the discharge slope*/
+#define BATSAMPLE_MAX_SLOPE 600
+
+typedef struct
+{
+    /*filtered reading, in the unit of battery_input*/
+    double filtered;
+    double percent;
+    /*discharge slope in %/h (negative when discharging)*/
+    double slope;
+    /*mA, NaN without battery_capacity*/
+    double current;
+    /*seconds until the empty percent, NaN when not discharging*/
+    double time_to_empty;
+    uint64_t samples;
+    uint64_t errors;
+    uint64_t overruns;
+    /*CLOCK_MONOTONIC time of the last successful reading*/
+    struct timespec last_sample;
+} batsample_value_t;
+
+/*single producer single consumer slot, a sequence lock: odd while the producer writes*/
+typedef struct
+{
+    uint32_t seq;
+    batsample_value_t value;
+} batsample_slot_t;
+
+typedef struct
+{
+    /*configuration*/
+    int rate;
+    int median;
+    double filter_hz;
+    double capacity;
+    int slope_window;
+    /*battery range of the percent mapping*/
+    double ratio;
+    double min_voltage;
+    double max_voltage;
+    double empty_percent;
+    /*sampler state, only touched by the thread*/
+    pfile_t file;
+    int running;
+    int started;
+    pthread_t thread;
+    long period_ns;
+    double history[BATSAMPLE_MAX_MEDIAN];
+    int n_history;
+    int head;
+    double alpha;
+    double filtered;
+    batsample_value_t value;
+    double slope_t[BATSAMPLE_MAX_SLOPE];
+    double slope_p[BATSAMPLE_MAX_SLOPE];
+    int n_slope;
+    int slope_head;
+    struct timespec start;
+    struct timespec last_point;
+    batsample_slot_t slot;
+} batsample_t;
+
+void batsample_init(batsample_t *bs);
+int batsample_config(batsample_t *bs, const char *name, const char *value);
+int batsample_open(batsample_t *bs, const char *path);
+/*latest published value, never blocks the caller*/
+int batsample_get(batsample_t *bs, batsample_value_t *value);
+/*1 when the last successful reading is older than 1s or 4 sampling periods*/
+int batsample_stale(batsample_t *bs, const batsample_value_t *value);
+void batsample_close(batsample_t *bs);
+float battery_map_percent(float volt, float min_voltage, float max_voltage);
+
+#endif
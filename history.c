@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "history.h"
+#include "metrics.h"
+
+/*appends between two attempts to write a full segment*/
+#define HISTORY_RETRY 60
+/*segments sharing the same first stamp*/
+#define HISTORY_MAX_SEQ 1000
+
+#define ALIGN_UP(x) (((x) + HISTORY_ALIGN - 1) & ~(uint64_t)(HISTORY_ALIGN - 1))
+
+static const char zeros[HISTORY_ALIGN];
+
+void history_init(history_t *hist)
+{
+    (void)memset(hist, 0, sizeof(*hist));
+    // one hour at 2Hz
+    hist->rows = 7200;
+}
+
+int history_config(history_t *hist, const char *name, const char *value)
+{
+    if (EQU(name, "history_dir"))
+    {
+        (void)snprintf(hist->dir, sizeof(hist->dir), "%s", value);
+    }
+    else if (EQU(name, "history_segment_rows"))
+    {
+        hist->rows = atoi(value);
+        if (hist->rows < 16)
+            hist->rows = 16;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int history_open(history_t *hist, int n_cols)
+{
+    if (mkdir(hist->dir, 0755) == -1 && errno != EEXIST)
+    {
+        M_ERROR(MODULE_NAME, "Unable to create history directory %s: %s", hist->dir, strerror(errno));
+        return -1;
+    }
+    hist->n_cols = n_cols;
+    hist->n_rows = 0;
+    hist->stamps = (int64_t *)malloc((size_t)hist->rows * sizeof(int64_t));
+    hist->cols = (double *)malloc((size_t)hist->rows * n_cols * sizeof(double));
+    hist->desc = (history_column_t *)malloc((size_t)n_cols * sizeof(history_column_t));
+    if (hist->stamps == NULL || hist->cols == NULL || hist->desc == NULL)
+    {
+        M_ERROR(MODULE_NAME, "Unable to allocate %d history rows", hist->rows);
+        history_close(hist);
+        return -1;
+    }
+    M_LOG(MODULE_NAME, "History: %d rows segments in %s", hist->rows, hist->dir);
+    return 0;
+}
+
+int history_append(history_t *hist, int64_t stamp_usec, const double *values)
+{
+    if (hist->stamps == NULL)
+        return 0;
+    if (hist->n_rows == hist->rows)
+    {
+        // the previous write failed: the buffered rows are kept and the new ones dropped until it succeeds
+        if (++hist->retry < HISTORY_RETRY || history_flush(hist) == -1)
+        {
+            hist->dropped++;
+            return hist->retry == 0 ? -1 : 0;
+        }
+    }
+    hist->stamps[hist->n_rows] = stamp_usec;
+    // column major: each metric goes to its own array
+    for (int i = 0; i < hist->n_cols; i++)
+        hist->cols[(size_t)i * hist->rows + hist->n_rows] = values[i];
+    hist->n_rows++;
+    if (hist->n_rows == hist->rows)
+        return history_flush(hist);
+    return 0;
+}
+
+static int write_pad(int fd, const void *data, size_t len, uint64_t *offset)
+{
+    size_t pad = ALIGN_UP(*offset + len) - (*offset + len);
+    if (len > 0 && guard_write(fd, (void *)data, len) != (int)len)
+        return -1;
+    if (pad > 0 && guard_write(fd, (void *)zeros, pad) != (int)pad)
+        return -1;
+    *offset += len + pad;
+    return 0;
+}
+
+/**
+ * Give the written segment its final name without ever replacing an
+ * existing one: after the clock stepped back, an older segment may
+ * already be named after the same first stamp
+ */
+static int segment_commit(history_t *hist, const char *tmp, char *path, size_t size, long long t_min)
+{
+    for (int seq = 0; seq < HISTORY_MAX_SEQ; seq++)
+    {
+        if (seq > 0)
+            (void)snprintf(path, size, HISTORY_SEQ_FMT, hist->dir, t_min, seq);
+        if (link(tmp, path) == 0)
+        {
+            (void)unlink(tmp);
+            if (seq > 0)
+                M_LOG(MODULE_NAME, "History: first stamp already taken, segment written as %s", path);
+            return 0;
+        }
+        if (errno == EEXIST)
+            continue;
+        // no hard links on this file system (e.g. vfat): check the name first
+        if (errno != EPERM && errno != EOPNOTSUPP)
+            return -1;
+        if (access(path, F_OK) == 0)
+            continue;
+        return rename(tmp, path);
+    }
+    errno = EEXIST;
+    return -1;
+}
+
+int history_flush(history_t *hist)
+{
+    char path[MAX_BUF * 2];
+    char tmp[MAX_BUF * 2 + 4];
+    history_header_t header;
+    history_column_t *desc = hist->desc;
+    uint64_t offset;
+    size_t col_size = (size_t)hist->n_rows * sizeof(double);
+    int fd, ret = -1;
+    if (hist->stamps == NULL || hist->n_rows == 0)
+        return 0;
+    (void)memset(desc, 0, (size_t)hist->n_cols * sizeof(history_column_t));
+    (void)memset(&header, 0, sizeof(header));
+    (void)memcpy(header.magic, HISTORY_MAGIC, sizeof(header.magic));
+    header.version = HISTORY_VERSION;
+    header.n_cols = (uint32_t)hist->n_cols;
+    header.n_rows = (uint64_t)hist->n_rows;
+    header.t_min = hist->stamps[0];
+    header.t_max = hist->stamps[hist->n_rows - 1];
+    header.stamp_offset = ALIGN_UP(sizeof(header) + hist->n_cols * sizeof(history_column_t));
+    offset = ALIGN_UP(header.stamp_offset + (uint64_t)hist->n_rows * sizeof(int64_t));
+    for (int i = 0; i < hist->n_cols; i++)
+    {
+        const double *col = hist->cols + (size_t)i * hist->rows;
+        (void)snprintf(desc[i].name, sizeof(desc[i].name), "%s", metric_name(i));
+        desc[i].min = NAN;
+        desc[i].max = NAN;
+        for (int j = 0; j < hist->n_rows; j++)
+        {
+            if (isnan(col[j]))
+                continue;
+            if (desc[i].n_valid == 0 || col[j] < desc[i].min)
+                desc[i].min = col[j];
+            if (desc[i].n_valid == 0 || col[j] > desc[i].max)
+                desc[i].max = col[j];
+            desc[i].n_valid++;
+        }
+        desc[i].offset = offset;
+        offset = ALIGN_UP(offset + col_size);
+    }
+    // written aside then linked, readers never see a partial segment
+    (void)snprintf(path, sizeof(path), HISTORY_SEG_FMT, hist->dir, (long long)header.t_min);
+    (void)snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to create history segment %s: %s", tmp, strerror(errno));
+        goto end;
+    }
+    offset = 0;
+    if (guard_write(fd, &header, sizeof(header)) != (int)sizeof(header))
+        goto fail;
+    offset = sizeof(header);
+    if (write_pad(fd, desc, hist->n_cols * sizeof(history_column_t), &offset) == -1 ||
+        write_pad(fd, hist->stamps, (size_t)hist->n_rows * sizeof(int64_t), &offset) == -1)
+        goto fail;
+    for (int i = 0; i < hist->n_cols; i++)
+    {
+        if (write_pad(fd, hist->cols + (size_t)i * hist->rows, col_size, &offset) == -1)
+            goto fail;
+    }
+    if (close(fd) == -1 || segment_commit(hist, tmp, path, sizeof(path), (long long)header.t_min) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to commit history segment %s: %s", path, strerror(errno));
+        (void)unlink(tmp);
+        goto end;
+    }
+    ret = 0;
+    goto end;
+fail:
+    (void)close(fd);
+    (void)unlink(tmp);
+end:
+    hist->retry = 0;
+    if (ret == 0)
+    {
+        hist->n_rows = 0;
+        if (hist->dropped > 0)
+            M_LOG(MODULE_NAME, "History: %llu rows dropped until the segment was written", (unsigned long long)hist->dropped);
+        hist->dropped = 0;
+    }
+    return ret;
+}
+
+void history_close(history_t *hist)
+{
+    if (history_flush(hist) == -1)
+        M_ERROR(MODULE_NAME, "Unable to write the last history segment");
+    free(hist->stamps);
+    free(hist->cols);
+    free(hist->desc);
+    hist->stamps = NULL;
+    hist->cols = NULL;
+    hist->desc = NULL;
+    hist->n_rows = 0;
+}
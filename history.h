@@ -0,0 +1,68 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+#include "sysmon.h"
+
+/**
+ * Columnar history segments. A segment file holds a header, one
+ * descriptor per column with its min/max zone map, the timestamp
+ * column and then one contiguous double array per metric.
+ * Columns start on a 64 bytes boundary, unavailable values are NaN
+ */
+#define HISTORY_MAGIC "SYSMCOL1"
+#define HISTORY_VERSION 1
+#define HISTORY_ALIGN 64
+#define HISTORY_SEG_FMT "%s/seg-%020lld.col"
+/*a segment whose first stamp is already taken (clock stepped back) gets a sequence suffix*/
+#define HISTORY_SEQ_FMT "%s/seg-%020lld-%d.col"
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t n_cols;
+    uint64_t n_rows;
+    /*stamp (usec) of the first and last rows*/
+    int64_t t_min;
+    int64_t t_max;
+    /*offset of the int64 stamp column*/
+    uint64_t stamp_offset;
+} history_header_t;
+
+typedef struct
+{
+    char name[32];
+    /*zone map over the non NaN values, NaN when there is none*/
+    double min;
+    double max;
+    uint64_t n_valid;
+    uint64_t offset;
+} history_column_t;
+
+typedef struct
+{
+    char dir[MAX_BUF];
+    int rows;
+    int n_rows;
+    int n_cols;
+    /*stamps, then n_cols columns of rows values*/
+    int64_t *stamps;
+    double *cols;
+    /*column descriptors of the next segment, allocated once*/
+    history_column_t *desc;
+    /*a segment that could not be written is kept: appends until the next attempt, rows lost meanwhile*/
+    int retry;
+    uint64_t dropped;
+} history_t;
+
+void history_init(history_t *hist);
+int history_config(history_t *hist, const char *name, const char *value);
+int history_open(history_t *hist, int n_cols);
+/*append one row, the segment is written when full and kept until written*/
+int history_append(history_t *hist, int64_t stamp_usec, const double *values);
+int history_flush(history_t *hist);
+void history_close(history_t *hist);
+
+#endif
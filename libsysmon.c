@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "libsysmon.h"
+#include "metrics.h"
+
+#define FRAME_MAX_SIZE (sizeof(sysmon_frame_t) + SYSMON_MAX_FIELDS * sizeof(double))
+
+struct sysmon
+{
+    int fd;
+    /*frames are received at once, the values are copied out of this buffer*/
+    uint64_t buf[FRAME_MAX_SIZE / sizeof(uint64_t)];
+};
+
+sysmon_t *sysmon_connect(const char *path)
+{
+    struct sockaddr_un address;
+    sysmon_t *client;
+    if (path == NULL || strlen(path) >= sizeof(address.sun_path))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    client = (sysmon_t *)calloc(1, sizeof(sysmon_t));
+    if (client == NULL)
+        return NULL;
+    (void)memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    (void)strcpy(address.sun_path, path);
+    client->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (client->fd == -1 || connect(client->fd, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        int err = errno;
+        if (client->fd != -1)
+            (void)close(client->fd);
+        free(client);
+        errno = err;
+        return NULL;
+    }
+    return client;
+}
+
+int sysmon_subscribe(sysmon_t *client, uint64_t mask, unsigned int decimation)
+{
+    sysmon_request_t req;
+    (void)memset(&req, 0, sizeof(req));
+    req.magic = SYSMON_MAGIC;
+    req.version = SYSMON_VERSION;
+    req.decimation = decimation == 0 ? 1 : (decimation > UINT16_MAX ? UINT16_MAX : (uint16_t)decimation);
+    req.mask = mask;
+    if (send(client->fd, &req, sizeof(req), MSG_NOSIGNAL) != (ssize_t)sizeof(req))
+        return -1;
+    return 0;
+}
+
+int sysmon_field(const char *name)
+{
+    return metric_lookup(name);
+}
+
+const char *sysmon_field_name(int id)
+{
+    return metric_name(id);
+}
+
+int sysmon_fd(sysmon_t *client)
+{
+    return client->fd;
+}
+
+int sysmon_dispatch(sysmon_t *client, sysmon_cb_t cb, void *user)
+{
+    sysmon_frame_t frame;
+    sysmon_sample_t sample;
+    const char *values;
+    uint64_t mask;
+    ssize_t len;
+    int k = 0;
+    do
+    {
+        len = recv(client->fd, client->buf, sizeof(client->buf), 0);
+    } while (len == -1 && errno == EINTR);
+    if (len == -1)
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    if (len == 0)
+    {
+        errno = ECONNRESET;
+        return -1;
+    }
+    if ((size_t)len < sizeof(frame))
+        goto invalid;
+    (void)memcpy(&frame, client->buf, sizeof(frame));
+    if (frame.magic != SYSMON_MAGIC || frame.n_values > SYSMON_MAX_FIELDS ||
+        (size_t)len != sizeof(frame) + frame.n_values * sizeof(double))
+        goto invalid;
+    sample.seq = frame.seq;
+    sample.stamp_usec = frame.stamp_usec;
+    sample.mask = frame.mask;
+    values = (const char *)client->buf + sizeof(frame);
+    for (int i = 0; i < SYSMON_MAX_FIELDS; i++)
+        sample.values[i] = NAN;
+    // values come in the order of the set bits
+    for (mask = frame.mask; mask != 0 && k < frame.n_values; mask &= mask - 1, k++)
+        (void)memcpy(&sample.values[__builtin_ctzll(mask)], values + k * sizeof(double), sizeof(double));
+    if (mask != 0 || k != frame.n_values)
+        goto invalid;
+    if (cb)
+        cb(user, &sample);
+    return 1;
+invalid:
+    errno = EPROTO;
+    return -1;
+}
+
+void sysmon_close(sysmon_t *client)
+{
+    if (client == NULL)
+        return;
+    if (client->fd != -1)
+        (void)close(client->fd);
+    free(client);
+}
@@ -0,0 +1,64 @@
+#ifndef LIBSYSMON_H
+#define LIBSYSMON_H
+
+#include <stdint.h>
+
+/**
+ * Client side of the sysmond subscription socket.
+ * A client sends a field mask and a decimation factor, the daemon
+ * then sends one binary frame every decimation samples carrying only
+ * the selected fields. Frames use the host byte order, the socket
+ * is a local SOCK_SEQPACKET one so each frame is a single message
+ */
+
+#define SYSMON_MAGIC 0x4e4d5953u /*"SYMN"*/
+#define SYSMON_VERSION 1
+#define SYSMON_MAX_FIELDS 64
+/*mask 0 subscribes to all the fields known by the daemon*/
+#define SYSMON_ALL_FIELDS 0ull
+#define SYSMON_FIELD_BIT(id) (1ull << (id))
+
+/*client -> daemon, may be sent again at any time to change the subscription*/
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t decimation;
+    uint64_t mask;
+} sysmon_request_t;
+
+/*daemon -> client, followed by n_values doubles in field id order*/
+typedef struct
+{
+    uint32_t magic;
+    uint16_t n_values;
+    uint16_t flags;
+    uint64_t seq;
+    int64_t stamp_usec;
+    uint64_t mask;
+} sysmon_frame_t;
+
+typedef struct
+{
+    uint64_t seq;
+    int64_t stamp_usec;
+    uint64_t mask;
+    /*indexed by field id, NaN for the fields not in mask or not available*/
+    double values[SYSMON_MAX_FIELDS];
+} sysmon_sample_t;
+
+typedef struct sysmon sysmon_t;
+typedef void (*sysmon_cb_t)(void *user, const sysmon_sample_t *sample);
+
+sysmon_t *sysmon_connect(const char *path);
+int sysmon_subscribe(sysmon_t *client, uint64_t mask, unsigned int decimation);
+/*field id of a metric name (e.g. cpu_temp), -1 if unknown*/
+int sysmon_field(const char *name);
+const char *sysmon_field_name(int id);
+/*socket to poll for readability when driving the client from an event loop*/
+int sysmon_fd(sysmon_t *client);
+/*receive and decode one frame: 1 when cb was called, 0 if none is pending, -1 on error or hang up*/
+int sysmon_dispatch(sysmon_t *client, sysmon_cb_t cb, void *user);
+void sysmon_close(sysmon_t *client);
+
+#endif
@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "metrics.h"
+
+static const struct
+{
+    const char *name;
+    int ref;
+} metric_table[METRIC_COUNT] = {
+    [METRIC_BATTERY] = {"battery", -1},
+    [METRIC_BATTERY_PERCENT] = {"battery_percent", -1},
+    [METRIC_CPU_TEMP] = {"cpu_temp", -1},
+    [METRIC_GPU_TEMP] = {"gpu_temp", -1},
+    [METRIC_CPU_USAGE] = {"cpu_usage", -1},
+    [METRIC_MEM_TOTAL] = {"mem_total", -1},
+    [METRIC_MEM_FREE] = {"mem_free", METRIC_MEM_TOTAL},
+    [METRIC_MEM_USED] = {"mem_used", METRIC_MEM_TOTAL},
+    [METRIC_MEM_BUFF_CACHE] = {"mem_buff_cache", METRIC_MEM_TOTAL},
+    [METRIC_MEM_AVAILABLE] = {"mem_available", METRIC_MEM_TOTAL},
+    [METRIC_MEM_SWAP_TOTAL] = {"mem_swap_total", -1},
+    [METRIC_MEM_SWAP_FREE] = {"mem_swap_free", METRIC_MEM_SWAP_TOTAL},
+    [METRIC_DISK_TOTAL] = {"disk_total", -1},
+    [METRIC_DISK_FREE] = {"disk_free", METRIC_DISK_TOTAL},
+    [METRIC_NET_RX_RATE] = {"net_rx_rate", -1},
+    [METRIC_NET_TX_RATE] = {"net_tx_rate", -1},
+    [METRIC_CPU_IOWAIT] = {"cpu_iowait", -1},
+    [METRIC_CPU_STEAL] = {"cpu_steal", -1},
+    [METRIC_POWER] = {"power_watts", -1},
+    [METRIC_SWAP_IN_RATE] = {"swap_in_rate", -1},
+    [METRIC_SWAP_OUT_RATE] = {"swap_out_rate", -1},
+    [METRIC_MAJOR_FAULT_RATE] = {"major_fault_rate", -1},
+};
+
+const char *metric_name(int id)
+{
+    if (id < 0 || id >= METRIC_COUNT)
+        return "unknown";
+    return metric_table[id].name;
+}
+
+int metric_lookup(const char *name)
+{
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        if (strcmp(metric_table[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+int metric_ref(int id)
+{
+    if (id < 0 || id >= METRIC_COUNT)
+        return -1;
+    return metric_table[id].ref;
+}
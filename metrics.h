@@ -0,0 +1,41 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/**
+ * Scalar view of a data record, refreshed once per sample.
+ * Rules and detectors work on this flat vector by index instead
+ * of looking into the collector structures
+ */
+typedef enum
+{
+    METRIC_BATTERY = 0,
+    METRIC_BATTERY_PERCENT,
+    METRIC_CPU_TEMP,
+    METRIC_GPU_TEMP,
+    METRIC_CPU_USAGE,
+    METRIC_MEM_TOTAL,
+    METRIC_MEM_FREE,
+    METRIC_MEM_USED,
+    METRIC_MEM_BUFF_CACHE,
+    METRIC_MEM_AVAILABLE,
+    METRIC_MEM_SWAP_TOTAL,
+    METRIC_MEM_SWAP_FREE,
+    METRIC_DISK_TOTAL,
+    METRIC_DISK_FREE,
+    METRIC_NET_RX_RATE,
+    METRIC_NET_TX_RATE,
+    METRIC_CPU_IOWAIT,
+    METRIC_CPU_STEAL,
+    METRIC_POWER,
+    METRIC_SWAP_IN_RATE,
+    METRIC_SWAP_OUT_RATE,
+    METRIC_MAJOR_FAULT_RATE,
+    METRIC_COUNT
+} metric_id_t;
+
+const char *metric_name(int id);
+int metric_lookup(const char *name);
+/*metric that a percent threshold on id refers to, -1 if none*/
+int metric_ref(int id);
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <dirent.h>
+
+#include "numa.h"
+
+#define NUMA_NODE_DIR "%s/sys/devices/system/node"
+
+static const char *numa_counters[NUMA_N_COUNTERS] = {
+    [NUMA_HIT] = "numa_hit",
+    [NUMA_MISS] = "numa_miss",
+    [NUMA_FOREIGN] = "numa_foreign",
+};
+
+static int node_cmp(const void *a, const void *b)
+{
+    return ((const numa_node_t *)a)->id - ((const numa_node_t *)b)->id;
+}
+
+/**
+ * Discover the nodeN directories once and keep their meminfo and
+ * numastat files open. Nothing is kept on a single node system,
+ * where the global statistics already tell everything
+ */
+int numa_open(numa_t *numa, const char *root_dir)
+{
+    char dir_path[MAX_BUF * 2];
+    char path[MAX_BUF * 4];
+    DIR *dir;
+    struct dirent *ent;
+    numa_node_t *node;
+    char *end;
+    long id;
+    numa->n_nodes = 0;
+    (void)snprintf(dir_path, sizeof(dir_path), NUMA_NODE_DIR, root_dir);
+    dir = opendir(dir_path);
+    if (dir == NULL)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open %s: %s", dir_path, strerror(errno));
+        return -1;
+    }
+    while ((ent = readdir(dir)) != NULL && numa->n_nodes < NUMA_MAX_NODES)
+    {
+        if (strncmp(ent->d_name, "node", 4) != 0)
+            continue;
+        id = strtol(ent->d_name + 4, &end, 10);
+        if (end == ent->d_name + 4 || *end != '\0')
+            continue;
+        node = &numa->nodes[numa->n_nodes];
+        (void)memset(node, 0, sizeof(*node));
+        node->id = (int)id;
+        pfile_init(&node->meminfo);
+        pfile_init(&node->numastat);
+        (void)snprintf(path, sizeof(path), "%s/%s/meminfo", dir_path, ent->d_name);
+        if (pfile_open(&node->meminfo, path) == -1)
+            continue;
+        (void)snprintf(path, sizeof(path), "%s/%s/numastat", dir_path, ent->d_name);
+        if (pfile_open(&node->numastat, path) == -1)
+        {
+            pfile_close(&node->meminfo);
+            continue;
+        }
+        numa->n_nodes++;
+    }
+    (void)closedir(dir);
+    if (numa->n_nodes < 2)
+    {
+        M_LOG(MODULE_NAME, "Single NUMA node, per node statistics disabled");
+        numa_close(numa);
+        return 0;
+    }
+    qsort(numa->nodes, numa->n_nodes, sizeof(numa->nodes[0]), node_cmp);
+    M_LOG(MODULE_NAME, "Found %d NUMA nodes", numa->n_nodes);
+    clock_gettime(CLOCK_MONOTONIC, &numa->last);
+    return 0;
+}
+
+/*"Node 0 MemFree:  3292216 kB" lines*/
+static void parse_meminfo(numa_node_t *node)
+{
+    char *ptr = node->meminfo.data;
+    char *key;
+    int found = 0;
+    while (ptr != NULL && found < 3)
+    {
+        // skip "Node N "
+        key = strchr(ptr, ' ');
+        key = key ? strchr(key + 1, ' ') : NULL;
+        if (key == NULL)
+            break;
+        key++;
+        if (strncmp(key, "MemFree:", 8) == 0)
+        {
+            node->mem_free = strtoul(key + 8, NULL, 10);
+            found++;
+        }
+        else if (strncmp(key, "FilePages:", 10) == 0)
+        {
+            node->file_pages = strtoul(key + 10, NULL, 10);
+            found++;
+        }
+        else if (strncmp(key, "AnonPages:", 10) == 0)
+        {
+            node->anon_pages = strtoul(key + 10, NULL, 10);
+            found++;
+        }
+        ptr = strchr(key, '\n');
+        if (ptr != NULL)
+            ptr++;
+    }
+}
+
+static void parse_numastat(numa_t *numa, numa_node_t *node, double elapsed)
+{
+    char *ptr = node->numastat.data;
+    uint64_t value;
+    size_t len;
+    while (ptr != NULL && *ptr != '\0')
+    {
+        for (int i = 0; i < NUMA_N_COUNTERS; i++)
+        {
+            len = strlen(numa_counters[i]);
+            if (strncmp(ptr, numa_counters[i], len) != 0 || ptr[len] != ' ')
+                continue;
+            value = strtoull(ptr + len, NULL, 10);
+            node->rate[i] = numa->primed && value >= node->last[i] ? (float)((value - node->last[i]) / elapsed) : 0.0f;
+            node->last[i] = value;
+            break;
+        }
+        ptr = strchr(ptr, '\n');
+        if (ptr != NULL)
+            ptr++;
+    }
+}
+
+int numa_read(numa_t *numa)
+{
+    struct timespec now;
+    double elapsed;
+    numa_node_t *node;
+    int ret = 0;
+    if (numa->n_nodes == 0)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - numa->last.tv_sec) + (now.tv_nsec - numa->last.tv_nsec) / 1.0e9;
+    numa->last = now;
+    if (elapsed <= 0.0)
+        elapsed = 1.0e-3;
+    for (int i = 0; i < numa->n_nodes; i++)
+    {
+        node = &numa->nodes[i];
+        if (pfile_read(&node->meminfo, 0) <= 0 || pfile_read(&node->numastat, 0) <= 0)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read statistics of NUMA node %d: %s", node->id, strerror(errno));
+            ret = -1;
+            continue;
+        }
+        parse_meminfo(node);
+        parse_numastat(numa, node, elapsed);
+    }
+    numa->primed = 1;
+    return ret;
+}
+
+void numa_encode(numa_t *numa, obuf_t *ob)
+{
+    numa_node_t *node;
+    if (numa->n_nodes == 0)
+        return;
+    OBUF_LIT(ob, ",\"numa\":[");
+    for (int i = 0; i < numa->n_nodes; i++)
+    {
+        node = &numa->nodes[i];
+        if (i > 0)
+            obuf_putc(ob, ',');
+        OBUF_LIT(ob, "{\"node\": ");
+        obuf_u64(ob, (uint64_t)node->id);
+        OBUF_LIT(ob, ",\"mem_free\": ");
+        obuf_u64(ob, node->mem_free);
+        OBUF_LIT(ob, ",\"file_pages\": ");
+        obuf_u64(ob, node->file_pages);
+        OBUF_LIT(ob, ",\"anon_pages\": ");
+        obuf_u64(ob, node->anon_pages);
+        for (int j = 0; j < NUMA_N_COUNTERS; j++)
+        {
+            OBUF_LIT(ob, ",\"");
+            obuf_puts(ob, numa_counters[j]);
+            OBUF_LIT(ob, "\": ");
+            obuf_fixed(ob, node->rate[j], 3);
+        }
+        obuf_putc(ob, '}');
+    }
+    obuf_putc(ob, ']');
+}
+
+void numa_close(numa_t *numa)
+{
+    for (int i = 0; i < numa->n_nodes; i++)
+    {
+        pfile_close(&numa->nodes[i].meminfo);
+        pfile_close(&numa->nodes[i].numastat);
+    }
+    numa->n_nodes = 0;
+}
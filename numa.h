@@ -0,0 +1,49 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "pfile.h"
+
+#define NUMA_MAX_NODES 64
+
+typedef enum
+{
+    NUMA_HIT = 0,
+    NUMA_MISS,
+    NUMA_FOREIGN,
+    NUMA_N_COUNTERS
+} numa_counter_t;
+
+typedef struct
+{
+    int id;
+    pfile_t meminfo;
+    pfile_t numastat;
+    /*kB*/
+    unsigned long mem_free;
+    unsigned long file_pages;
+    unsigned long anon_pages;
+    uint64_t last[NUMA_N_COUNTERS];
+    /*pages per second*/
+    float rate[NUMA_N_COUNTERS];
+} numa_node_t;
+
+typedef struct
+{
+    int enabled;
+    int n_nodes;
+    int primed;
+    numa_node_t nodes[NUMA_MAX_NODES];
+    struct timespec last;
+} numa_t;
+
+int numa_open(numa_t *numa, const char *root_dir);
+int numa_read(numa_t *numa);
+void numa_encode(numa_t *numa, obuf_t *ob);
+void numa_close(numa_t *numa);
+
+#endif
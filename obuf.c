@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "obuf.h"
+
+static const char digits2[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const uint64_t pow10_tab[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+    1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL};
+
+void obuf_init(obuf_t *ob)
+{
+    ob->data = NULL;
+    ob->len = 0;
+    ob->cap = 0;
+    ob->error = 0;
+    ob->fixed = 0;
+}
+
+void obuf_free(obuf_t *ob)
+{
+    if (ob->data)
+        free(ob->data);
+    obuf_init(ob);
+}
+
+int obuf_reserve(obuf_t *ob, size_t n)
+{
+    size_t cap;
+    char *ptr;
+    if (ob->len + n <= ob->cap)
+        return 0;
+    if (ob->fixed)
+    {
+        ob->error = 1;
+        return -1;
+    }
+    cap = ob->cap ? ob->cap : OBUF_MIN_CAP;
+    while (cap < ob->len + n)
+        cap <<= 1;
+    ptr = (char *)realloc(ob->data, cap);
+    if (!ptr)
+    {
+        ob->error = 1;
+        return -1;
+    }
+    ob->data = ptr;
+    ob->cap = cap;
+    return 0;
+}
+
+int obuf_freeze(obuf_t *ob, size_t cap)
+{
+    int ret = 0;
+    ob->fixed = 0;
+    if (cap > ob->len)
+        ret = obuf_reserve(ob, cap - ob->len);
+    ob->fixed = 1;
+    return ret;
+}
+
+void obuf_put(obuf_t *ob, const char *str, size_t len)
+{
+    if (obuf_reserve(ob, len) == -1)
+        return;
+    (void)memcpy(ob->data + ob->len, str, len);
+    ob->len += len;
+}
+
+void obuf_puts(obuf_t *ob, const char *str)
+{
+    obuf_put(ob, str, strlen(str));
+}
+
+void obuf_putc(obuf_t *ob, char c)
+{
+    if (obuf_reserve(ob, 1) == -1)
+        return;
+    ob->data[ob->len++] = c;
+}
+
+/*write the decimal digits of value right aligned, ending at end*/
+static char *fmt_u64(char *end, uint64_t value)
+{
+    while (value >= 100)
+    {
+        const char *d = digits2 + (value % 100) * 2;
+        value /= 100;
+        *--end = d[1];
+        *--end = d[0];
+    }
+    if (value >= 10)
+    {
+        const char *d = digits2 + value * 2;
+        *--end = d[1];
+        *--end = d[0];
+    }
+    else
+    {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+void obuf_u64(obuf_t *ob, uint64_t value)
+{
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *start = fmt_u64(end, value);
+    obuf_put(ob, start, (size_t)(end - start));
+}
+
+void obuf_i64(obuf_t *ob, int64_t value)
+{
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *start = fmt_u64(end, value < 0 ? 0 - (uint64_t)value : (uint64_t)value);
+    if (value < 0)
+        *--start = '-';
+    obuf_put(ob, start, (size_t)(end - start));
+}
+
+/**
+ * Same output as printf("%.*f", decimals, value).
+ * The value is scaled and rounded to nearest-even like glibc does on exact ties,
+ * the rare inputs where the scaled product is inexact and too close to a tie
+ * (and nan, inf or huge values) fall back to snprintf
+ */
+void obuf_fixed(obuf_t *ob, double value, int decimals)
+{
+    char tmp[384];
+    char *end = tmp + sizeof(tmp);
+    char *start;
+    double scaled, rounded, err;
+    uint64_t n, scale;
+    int i;
+    if (decimals < 0)
+        decimals = 0;
+    if (decimals > 9)
+        decimals = 9;
+    scale = pow10_tab[decimals];
+    scaled = fabs(value) * (double)scale;
+    if (!isfinite(scaled) || scaled >= 9.0e18)
+        goto fallback;
+    rounded = rint(scaled);
+    err = fma(fabs(value), (double)scale, -scaled);
+    if (err != 0.0 && fabs(fabs(scaled - rounded) - 0.5) <= fabs(err))
+        goto fallback;
+    n = (uint64_t)rounded;
+    start = end;
+    if (decimals > 0)
+    {
+        for (i = 0; i < decimals; i++)
+        {
+            *--start = (char)('0' + n % 10);
+            n /= 10;
+        }
+        *--start = '.';
+    }
+    start = fmt_u64(start, n);
+    if (signbit(value))
+        *--start = '-';
+    obuf_put(ob, start, (size_t)(end - start));
+    return;
+fallback:
+    i = snprintf(tmp, sizeof(tmp), "%.*f", decimals, value);
+    if (i > 0 && i < (int)sizeof(tmp))
+        obuf_put(ob, tmp, (size_t)i);
+    else
+        OBUF_LIT(ob, "0");
+}
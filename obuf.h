@@ -0,0 +1,45 @@
+#ifndef OBUF_H
+#define OBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OBUF_MIN_CAP 1024
+
+/**
+ * Growable output buffer with locale independent number formatting,
+ * used to encode the data records without snprintf/strlen round trips
+ */
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    /*set when an allocation failed, the content is then incomplete*/
+    int error;
+    /*set by obuf_freeze: the buffer never grows, an append that does not fit sets error*/
+    int fixed;
+} obuf_t;
+
+/*append a string literal*/
+#define OBUF_LIT(ob, s) obuf_put((ob), (s), sizeof(s) - 1)
+
+void obuf_init(obuf_t *ob);
+void obuf_free(obuf_t *ob);
+int obuf_reserve(obuf_t *ob, size_t n);
+/*allocate cap bytes now, then never grow (real-time mode)*/
+int obuf_freeze(obuf_t *ob, size_t cap);
+void obuf_put(obuf_t *ob, const char *str, size_t len);
+void obuf_puts(obuf_t *ob, const char *str);
+void obuf_putc(obuf_t *ob, char c);
+void obuf_u64(obuf_t *ob, uint64_t value);
+void obuf_i64(obuf_t *ob, int64_t value);
+void obuf_fixed(obuf_t *ob, double value, int decimals);
+
+static inline void obuf_reset(obuf_t *ob)
+{
+    ob->len = 0;
+    ob->error = 0;
+}
+
+#endif
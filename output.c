@@ -0,0 +1,573 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "output.h"
+#include "metrics.h"
+#include "libsysmon.h"
+
+#define OUT_QUEUE_DEFAULT (1 << 20)
+
+static const char *format_names[OUT_N_FORMATS] = {"json", "binary", "openmetrics"};
+
+static double elapsed_us(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1e6 + (now.tv_nsec - since->tv_nsec) / 1e3;
+}
+
+static int open_unix_socket(const char *path)
+{
+    struct sockaddr_un address;
+    struct timeval timeout = {1, 0};
+    int fd;
+    (void)memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    (void)strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to create Unix domain socket: %s", strerror(errno));
+        return -1;
+    }
+    (void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)(&address), sizeof(address)) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to connect to socket '%s': %s", address.sun_path, strerror(errno));
+        (void)close(fd);
+        return -1;
+    }
+    M_LOG(MODULE_NAME, "Socket %s is created successfully", path);
+    return fd;
+}
+
+static int open_tcp_socket(const char *dest)
+{
+    char host[MAX_BUF];
+    char *port;
+    struct addrinfo hints, *res = NULL, *ai;
+    struct timeval timeout = {1, 0};
+    int fd = -1;
+    (void)strncpy(host, dest, MAX_BUF - 1);
+    host[MAX_BUF - 1] = '\0';
+    port = strrchr(host, ':');
+    if (port == NULL)
+    {
+        M_ERROR(MODULE_NAME, "Invalid TCP destination: %s", dest);
+        return -1;
+    }
+    *port++ = '\0';
+    (void)memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+    {
+        M_ERROR(MODULE_NAME, "Unable to resolve %s", dest);
+        return -1;
+    }
+    for (ai = res; ai != NULL; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            continue;
+        // bound the connect and write time, the sampling loop must not stall on the network
+        (void)setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        (void)close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to connect to %s: %s", dest, strerror(errno));
+        return -1;
+    }
+    M_LOG(MODULE_NAME, "Connected to %s", dest);
+    return fd;
+}
+
+void output_init(output_t *out)
+{
+    (void)memset(out, 0, sizeof(*out));
+    for (int i = 0; i < OUT_N_FORMATS; i++)
+        obuf_init(&out->encoded[i]);
+}
+
+int output_config(output_t *out, const char *name, const char *value)
+{
+    if (EQU(name, "output"))
+    {
+        if (output_add(out, value) == -1)
+            M_ERROR(MODULE_NAME, "Invalid output: %s", value);
+        // an explicit sink list reports its statistics
+        out->stats = 1;
+    }
+    else if (EQU(name, "output_stats"))
+    {
+        out->stats = atoi(value);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static int format_lookup(const char *name)
+{
+    for (int format = 0; name && format < OUT_N_FORMATS; format++)
+    {
+        if (strcmp(name, format_names[format]) == 0)
+            return format;
+    }
+    return -1;
+}
+
+/*sink with the default options, not yet added*/
+static out_sink_t *sink_new(output_t *out, int format, const char *dest)
+{
+    out_sink_t *sink;
+    if (out->n_sinks >= MAX_OUTPUTS)
+    {
+        M_ERROR(MODULE_NAME, "Too many outputs, at most %d", MAX_OUTPUTS);
+        return NULL;
+    }
+    if (format < 0 || dest == NULL || dest[0] == '\0')
+        return NULL;
+    sink = (out_sink_t *)calloc(1, sizeof(out_sink_t));
+    if (sink == NULL)
+        return NULL;
+    sink->format = (out_format_t)format;
+    (void)snprintf(sink->dest, sizeof(sink->dest), "%s", dest);
+    if (strcmp(dest, "stdout") == 0)
+        sink->type = OUT_STDOUT;
+    else if (strncmp(dest, "sock:", 5) == 0)
+        sink->type = OUT_UNIX;
+    else if (strncmp(dest, "tcp:", 4) == 0)
+        sink->type = OUT_TCP;
+    else
+        sink->type = OUT_FILE;
+    sink->policy = OUT_POLICY_BLOCK;
+    sink->decimation = 1;
+    sink->batch_records = -1;
+    sink->batch_ms = -1;
+    sink->queue_max = OUT_QUEUE_DEFAULT;
+    sink->fd = -1;
+    file_sink_init(&sink->file);
+    obuf_init(&sink->pending);
+    sketch_init(&sink->latency);
+    return sink;
+}
+
+int output_add(output_t *out, const char *spec)
+{
+    char tmp[MAX_BUF * 2];
+    char *token, *value, *saveptr;
+    out_sink_t *sink;
+    (void)snprintf(tmp, sizeof(tmp), "%s", spec);
+    token = strtok_r(tmp, " \t", &saveptr);
+    value = strtok_r(NULL, " \t", &saveptr);
+    sink = sink_new(out, format_lookup(token), value);
+    if (sink == NULL)
+        return -1;
+    while ((token = strtok_r(NULL, " \t", &saveptr)) != NULL)
+    {
+        value = strtok_r(NULL, " \t", &saveptr);
+        if (value == NULL)
+            goto error;
+        if (strcmp(token, "decimate") == 0)
+            sink->decimation = atoi(value) < 1 ? 1 : atoi(value);
+        else if (strcmp(token, "batch") == 0)
+            sink->batch_records = atoi(value) < 1 ? 1 : atoi(value);
+        else if (strcmp(token, "batch_ms") == 0)
+            sink->batch_ms = atoi(value);
+        else if (strcmp(token, "queue") == 0)
+            sink->queue_max = sink_parse_size(value);
+        else if (strcmp(token, "policy") == 0 && strcmp(value, "drop") == 0)
+            sink->policy = OUT_POLICY_DROP;
+        else if (strcmp(token, "policy") == 0 && strcmp(value, "block") == 0)
+            sink->policy = OUT_POLICY_BLOCK;
+        else
+            goto error;
+    }
+    out->sinks[out->n_sinks++] = sink;
+    return 0;
+error:
+    free(sink);
+    return -1;
+}
+
+int output_add_dest(output_t *out, const char *format, const char *dest)
+{
+    out_sink_t *sink = sink_new(out, format_lookup(format), dest);
+    if (sink == NULL)
+        return -1;
+    out->sinks[out->n_sinks++] = sink;
+    return 0;
+}
+
+int output_open(output_t *out, const file_sink_t *file_conf)
+{
+    int ret = 0;
+    for (int i = 0; i < out->n_sinks; i++)
+    {
+        out_sink_t *sink = out->sinks[i];
+        if (sink->type != OUT_FILE)
+        {
+            if (sink->batch_records < 1)
+                sink->batch_records = 1;
+            if (sink->batch_ms < 0)
+                sink->batch_ms = 0;
+            continue;
+        }
+        // the file_* settings apply to every file sink, the sink options override the batching
+        sink->file = *file_conf;
+        if (sink->batch_records > 0)
+            sink->file.batch_records = sink->batch_records;
+        if (sink->batch_ms >= 0)
+            sink->file.batch_ms = sink->batch_ms;
+        if (file_sink_open(&sink->file, sink->dest) == -1)
+            ret = -1;
+    }
+    return ret;
+}
+
+static void drop_queue(out_sink_t *sink)
+{
+    sink->drops += sink->queued;
+    sink->queued = 0;
+    sink->n_pending = 0;
+    sink->head = 0;
+    obuf_reset(&sink->pending);
+}
+
+static void sock_flush(out_sink_t *sink)
+{
+    struct timespec start;
+    ssize_t n;
+    int flags = MSG_NOSIGNAL | (sink->policy == OUT_POLICY_DROP ? MSG_DONTWAIT : 0);
+    sink->n_pending = 0;
+    if (sink->head == sink->pending.len)
+        return;
+    if (sink->fd < 0)
+    {
+        // reconnect at most once per second, the queue keeps the records meanwhile
+        if (time(NULL) == sink->retry)
+            return;
+        sink->retry = time(NULL);
+        sink->fd = sink->type == OUT_TCP ? open_tcp_socket(sink->dest + 4) : open_unix_socket(sink->dest + 5);
+        if (sink->fd < 0)
+            return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (sink->head < sink->pending.len)
+    {
+        n = send(sink->fd, sink->pending.data + sink->head, sink->pending.len - sink->head, flags);
+        if (n > 0)
+        {
+            sink->head += (size_t)n;
+            sink->bytes += (uint64_t)n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && sink->policy == OUT_POLICY_DROP)
+            break;
+        // peer gone or send timeout: a partly sent record can not be resumed on a new connection
+        M_ERROR(MODULE_NAME, "Output %s: %s", sink->dest, n == 0 ? "closed" : strerror(errno));
+        sink->errors++;
+        (void)close(sink->fd);
+        sink->fd = -1;
+        drop_queue(sink);
+        break;
+    }
+    sketch_add(&sink->latency, elapsed_us(&start));
+    if (sink->head == sink->pending.len)
+    {
+        sink->queued = 0;
+        sink->head = 0;
+        obuf_reset(&sink->pending);
+    }
+}
+
+static void sink_write(out_sink_t *sink, const char *data, size_t len)
+{
+    struct timespec start;
+    switch (sink->type)
+    {
+    case OUT_STDOUT:
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        (void)fwrite(data, 1, len, stdout);
+        sketch_add(&sink->latency, elapsed_us(&start));
+        sink->bytes += len;
+        sink->records++;
+        break;
+    case OUT_FILE:
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (file_sink_write(&sink->file, data, len) < 0)
+        {
+            sink->errors++;
+            sink->drops++;
+        }
+        else
+        {
+            sink->bytes += len;
+            sink->records++;
+        }
+        sketch_add(&sink->latency, elapsed_us(&start));
+        break;
+    default:
+        if (sink->pending.len - sink->head + len > sink->queue_max && sink->policy == OUT_POLICY_BLOCK)
+            sock_flush(sink);
+        if (sink->head > 0 && (sink->head >= sink->pending.len / 2 || sink->pending.len + len > sink->pending.cap))
+        {
+            // keep the queue at the head of its buffer
+            (void)memmove(sink->pending.data, sink->pending.data + sink->head, sink->pending.len - sink->head);
+            sink->pending.len -= sink->head;
+            sink->head = 0;
+        }
+        if (sink->pending.len - sink->head + len > sink->queue_max)
+        {
+            sink->drops++;
+            break;
+        }
+        obuf_put(&sink->pending, data, len);
+        if (sink->pending.error)
+        {
+            sink->pending.error = 0;
+            sink->drops++;
+            break;
+        }
+        if (sink->n_pending == 0)
+            clock_gettime(CLOCK_MONOTONIC, &sink->first_pending);
+        sink->n_pending++;
+        sink->queued++;
+        sink->records++;
+        if (sink->n_pending >= sink->batch_records)
+            sock_flush(sink);
+        break;
+    }
+}
+
+/*flush the batches that are due on time, and retry the queues of the slow peers*/
+static void sink_tick(out_sink_t *sink)
+{
+    if (sink->type == OUT_FILE)
+    {
+        if (sink->file.n_pending > 0 && sink->file.batch_ms > 0 &&
+            elapsed_us(&sink->file.first_pending) >= sink->file.batch_ms * 1e3)
+            (void)file_sink_flush(&sink->file);
+        return;
+    }
+    if (sink->type == OUT_STDOUT || sink->head == sink->pending.len)
+        return;
+    if (sink->head > 0 || sink->n_pending == 0 ||
+        (sink->batch_ms > 0 && elapsed_us(&sink->first_pending) >= sink->batch_ms * 1e3))
+        sock_flush(sink);
+}
+
+static void encode_binary(output_t *out, obuf_t *ob, const double *metrics, int n_metrics, const struct timeval *now)
+{
+    sysmon_frame_t frame;
+    if (n_metrics > SYSMON_MAX_FIELDS)
+        n_metrics = SYSMON_MAX_FIELDS;
+    (void)memset(&frame, 0, sizeof(frame));
+    frame.magic = SYSMON_MAGIC;
+    frame.n_values = (uint16_t)n_metrics;
+    frame.seq = out->seq;
+    frame.stamp_usec = (int64_t)now->tv_sec * 1000000 + now->tv_usec;
+    frame.mask = n_metrics == SYSMON_MAX_FIELDS ? ~0ull : SYSMON_FIELD_BIT(n_metrics) - 1;
+    obuf_put(ob, (const char *)&frame, sizeof(frame));
+    obuf_put(ob, (const char *)metrics, n_metrics * sizeof(double));
+}
+
+/*label value, with the escapes of the text format (also valid in a JSON string)*/
+static void put_label(obuf_t *ob, const char *value)
+{
+    size_t len;
+    while (*value != '\0')
+    {
+        len = strcspn(value, "\\\"\n");
+        obuf_put(ob, value, len);
+        value += len;
+        if (*value == '\0')
+            break;
+        obuf_putc(ob, '\\');
+        obuf_putc(ob, *value == '\n' ? 'n' : *value);
+        value++;
+    }
+}
+
+static void encode_openmetrics(output_t *out, obuf_t *ob, const double *metrics, int n_metrics, const struct timeval *now)
+{
+    for (int i = 0; i < n_metrics; i++)
+    {
+        if (isnan(metrics[i]))
+            continue;
+        OBUF_LIT(ob, "# TYPE sysmon_");
+        obuf_puts(ob, metric_name(i));
+        OBUF_LIT(ob, " gauge\nsysmon_");
+        obuf_puts(ob, metric_name(i));
+        if (out->host && out->host[0] != '\0')
+        {
+            OBUF_LIT(ob, "{host=\"");
+            put_label(ob, out->host);
+            OBUF_LIT(ob, "\"}");
+        }
+        obuf_putc(ob, ' ');
+        obuf_fixed(ob, metrics[i], 3);
+        obuf_putc(ob, ' ');
+        obuf_u64(ob, (uint64_t)now->tv_sec);
+        obuf_putc(ob, '.');
+        obuf_put(ob, "00", 2 - (now->tv_usec >= 10000) - (now->tv_usec >= 100000));
+        obuf_u64(ob, (uint64_t)now->tv_usec / 1000);
+        obuf_putc(ob, '\n');
+    }
+    OBUF_LIT(ob, "# EOF\n");
+}
+
+void output_record(output_t *out, const double *metrics, int n_metrics, const struct timeval *now)
+{
+    int due[MAX_OUTPUTS];
+    int need[OUT_N_FORMATS] = {0};
+    out->seq++;
+    for (int i = 0; i < out->n_sinks; i++)
+    {
+        out_sink_t *sink = out->sinks[i];
+        due[i] = sink->tick == 0;
+        sink->tick = (sink->tick + 1) % sink->decimation;
+        need[sink->format] |= due[i];
+    }
+    // each format is encoded at most once, and shared by its sinks
+    for (int f = 0; f < OUT_N_FORMATS; f++)
+    {
+        obuf_t *ob = &out->encoded[f];
+        if (!need[f])
+            continue;
+        obuf_reset(ob);
+        if (f == OUT_FMT_JSON && out->encode_json)
+            out->encode_json(out->user, ob, now);
+        else if (f == OUT_FMT_BINARY)
+            encode_binary(out, ob, metrics, n_metrics, now);
+        else if (f == OUT_FMT_OPENMETRICS)
+            encode_openmetrics(out, ob, metrics, n_metrics, now);
+        if (ob->error)
+        {
+            M_ERROR(MODULE_NAME, "Unable to encode %s output record, dropped", format_names[f]);
+            need[f] = 0;
+        }
+    }
+    // the JSON record now carries the write latencies so far, the writes below start the next report
+    if (out->stats && out->encode_json && need[OUT_FMT_JSON])
+    {
+        for (int i = 0; i < out->n_sinks; i++)
+            sketch_reset(&out->sinks[i]->latency);
+    }
+    for (int i = 0; i < out->n_sinks; i++)
+    {
+        out_sink_t *sink = out->sinks[i];
+        if (due[i] && need[sink->format])
+            sink_write(sink, out->encoded[sink->format].data, out->encoded[sink->format].len);
+        else if (due[i])
+            sink->drops++;
+        sink_tick(sink);
+    }
+}
+
+void output_event(output_t *out, obuf_t *event)
+{
+    if (event->error)
+        return;
+    for (int i = 0; i < out->n_sinks; i++)
+    {
+        if (out->sinks[i]->format == OUT_FMT_JSON)
+            sink_write(out->sinks[i], event->data, event->len);
+        // the only writes in aggregator mode: the due batches and slow queues are flushed here too
+        sink_tick(out->sinks[i]);
+    }
+}
+
+void output_encode_stats(output_t *out, obuf_t *ob)
+{
+    if (!out->stats || out->n_sinks == 0)
+        return;
+    OBUF_LIT(ob, ",\"outputs\":[");
+    for (int i = 0; i < out->n_sinks; i++)
+    {
+        out_sink_t *sink = out->sinks[i];
+        if (i > 0)
+            obuf_putc(ob, ',');
+        OBUF_LIT(ob, "{\"dest\":\"");
+        put_label(ob, sink->dest);
+        OBUF_LIT(ob, "\",\"format\":\"");
+        obuf_puts(ob, format_names[sink->format]);
+        OBUF_LIT(ob, "\",\"records\": ");
+        obuf_u64(ob, sink->records);
+        OBUF_LIT(ob, ",\"drops\": ");
+        obuf_u64(ob, sink->drops);
+        OBUF_LIT(ob, ",\"errors\": ");
+        obuf_u64(ob, sink->errors);
+        OBUF_LIT(ob, ",\"bytes\": ");
+        obuf_u64(ob, sink->bytes);
+        OBUF_LIT(ob, ",\"queued\": ");
+        obuf_u64(ob, sink->pending.len - sink->head);
+        // write latency of the writes since the previous record, reset once the record is encoded
+        OBUF_LIT(ob, ",\"write_us\":");
+        sketch_encode(&sink->latency, ob, 1);
+        obuf_putc(ob, '}');
+    }
+    obuf_putc(ob, ']');
+}
+
+int output_reserve(output_t *out)
+{
+    int ret = 0;
+    // the encoded records get twice their first size, the sink queues their full limit
+    for (int f = 0; f < OUT_N_FORMATS; f++)
+        ret |= obuf_freeze(&out->encoded[f], out->encoded[f].len > 0 ? out->encoded[f].len * 2 : OBUF_MIN_CAP);
+    for (int i = 0; i < out->n_sinks; i++)
+    {
+        out_sink_t *sink = out->sinks[i];
+        size_t size = out->encoded[sink->format].cap;
+        if (sink->type == OUT_FILE)
+            ret |= file_sink_freeze(&sink->file, size * sink->file.batch_records);
+        else if (sink->type != OUT_STDOUT)
+            ret |= obuf_freeze(&sink->pending, sink->queue_max);
+    }
+    return ret;
+}
+
+void output_close(output_t *out)
+{
+    for (int i = 0; i < out->n_sinks; i++)
+    {
+        out_sink_t *sink = out->sinks[i];
+        if (sink->type == OUT_FILE)
+        {
+            file_sink_close(&sink->file);
+        }
+        else if (sink->type != OUT_STDOUT)
+        {
+            sock_flush(sink);
+            if (sink->fd >= 0)
+                (void)close(sink->fd);
+        }
+        M_LOG(MODULE_NAME, "Output %s (%s): %llu records, %llu drops, %llu errors", sink->dest,
+              format_names[sink->format], (unsigned long long)sink->records, (unsigned long long)sink->drops,
+              (unsigned long long)sink->errors);
+        obuf_free(&sink->pending);
+        free(sink);
+        out->sinks[i] = NULL;
+    }
+    out->n_sinks = 0;
+    for (int f = 0; f < OUT_N_FORMATS; f++)
+        obuf_free(&out->encoded[f]);
+}
@@ -0,0 +1,102 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "sink.h"
+#include "sketch.h"
+
+#define MAX_OUTPUTS 8
+
+typedef enum
+{
+    OUT_FMT_JSON = 0,
+    OUT_FMT_BINARY,
+    OUT_FMT_OPENMETRICS,
+    OUT_N_FORMATS
+} out_format_t;
+
+typedef enum
+{
+    OUT_STDOUT = 0,
+    OUT_FILE,
+    OUT_UNIX,
+    OUT_TCP
+} out_type_t;
+
+typedef enum
+{
+    /*wait for the peer (bounded by the 1s send timeout)*/
+    OUT_POLICY_BLOCK = 0,
+    /*never wait: records that do not fit in the queue are dropped*/
+    OUT_POLICY_DROP
+} out_policy_t;
+
+typedef struct
+{
+    char dest[MAX_BUF];
+    out_type_t type;
+    out_format_t format;
+    out_policy_t policy;
+    int decimation;
+    int tick;
+    /*-1: file sinks use the file_batch_* settings*/
+    int batch_records;
+    int batch_ms;
+    size_t queue_max;
+    /*sockets: persistent connection, reconnected at most once per second*/
+    int fd;
+    time_t retry;
+    file_sink_t file;
+    /*sockets: records waiting for the batch or for the peer, always whole records after the head*/
+    obuf_t pending;
+    size_t head;
+    /*records added since the last flush, and records still in the queue*/
+    int n_pending;
+    int queued;
+    struct timespec first_pending;
+    uint64_t records;
+    uint64_t drops;
+    uint64_t errors;
+    uint64_t bytes;
+    sketch_t latency;
+} out_sink_t;
+
+/*encode the full JSON record of the current sample*/
+typedef void (*out_encode_t)(void *user, obuf_t *ob, const struct timeval *now);
+
+typedef struct
+{
+    int n_sinks;
+    out_sink_t *sinks[MAX_OUTPUTS];
+    /*report the per sink statistics in the JSON records*/
+    int stats;
+    uint64_t seq;
+    const char *host;
+    obuf_t encoded[OUT_N_FORMATS];
+    out_encode_t encode_json;
+    void *user;
+} output_t;
+
+void output_init(output_t *out);
+int output_config(output_t *out, const char *name, const char *value);
+/*add a sink: <format> <destination> [decimate n] [batch n] [batch_ms n] [queue size] [policy block|drop]*/
+int output_add(output_t *out, const char *spec);
+/*add a sink with the default options, dest is taken as is (a path may contain spaces)*/
+int output_add_dest(output_t *out, const char *format, const char *dest);
+/*file sinks start from the file_* settings of file_conf*/
+int output_open(output_t *out, const file_sink_t *file_conf);
+void output_record(output_t *out, const double *metrics, int n_metrics, const struct timeval *now);
+/*events and forwarded records go to the JSON sinks, without decimation*/
+void output_event(output_t *out, obuf_t *event);
+/*the write latencies are reset by output_record once its JSON record is encoded*/
+void output_encode_stats(output_t *out, obuf_t *ob);
+/*size the buffers after the first record, then never grow them (real-time mode)*/
+int output_reserve(output_t *out);
+void output_close(output_t *out);
+
+#endif
@@ -0,0 +1,201 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "sysmon.h"
+#include "perf.h"
+
+static const struct
+{
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    perf_group_id_t group;
+} perf_events[PERF_N_COUNTERS] = {
+    [PERF_CONTEXT_SWITCHES] = {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, PERF_GROUP_SW},
+    [PERF_CPU_MIGRATIONS] = {"cpu_migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, PERF_GROUP_SW},
+    [PERF_PAGE_FAULTS] = {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, PERF_GROUP_SW},
+    [PERF_MAJOR_FAULTS] = {"major_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ, PERF_GROUP_SW},
+    [PERF_CYCLES] = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, PERF_GROUP_HW},
+    [PERF_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, PERF_GROUP_HW},
+};
+
+static int event_open(perf_counter_t counter, int cpu, int group)
+{
+    struct perf_event_attr attr;
+    (void)memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_events[counter].type;
+    attr.config = perf_events[counter].config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = (group == -1);
+    return (int)syscall(SYS_perf_event_open, &attr, -1, cpu, group, PERF_FLAG_FD_CLOEXEC);
+}
+
+int perf_open(perf_t *perf, int n_cpus)
+{
+    int fd, opened = 0;
+    perf_cpu_t *pc;
+    perf_group_t *group;
+    perf->n_cpus = n_cpus;
+    perf->cpus = (perf_cpu_t *)calloc(n_cpus, sizeof(perf_cpu_t));
+    // no descriptor is valid before it is opened, perf_close may run at any point below
+    for (int cpu = 0; perf->cpus && cpu < n_cpus; cpu++)
+    {
+        pc = &perf->cpus[cpu];
+        for (int g = 0; g < PERF_N_GROUPS; g++)
+            pc->groups[g].leader = -1;
+        for (int i = 0; i < PERF_N_COUNTERS; i++)
+        {
+            pc->fds[i] = -1;
+            pc->index[i] = -1;
+        }
+    }
+    // nr, time_enabled, time_running, values
+    perf->rbuf = (uint64_t *)calloc(3 + PERF_N_COUNTERS, sizeof(uint64_t));
+    if (!perf->cpus || !perf->rbuf)
+    {
+        M_ERROR(MODULE_NAME, "Unable to allocate perf counters: %s", strerror(errno));
+        perf_close(perf);
+        return -1;
+    }
+    for (int cpu = 0; cpu < n_cpus; cpu++)
+    {
+        pc = &perf->cpus[cpu];
+        for (int i = 0; i < PERF_N_COUNTERS; i++)
+        {
+            group = &pc->groups[perf_events[i].group];
+            fd = event_open((perf_counter_t)i, cpu, group->leader);
+            if (fd == -1)
+            {
+                if (cpu == 0)
+                    M_LOG(MODULE_NAME, "perf counter %s is not available: %s", perf_events[i].name, strerror(errno));
+                continue;
+            }
+            if (group->leader == -1)
+                group->leader = fd;
+            pc->fds[i] = fd;
+            pc->index[i] = group->n_events++;
+            perf->available[i] = 1;
+        }
+        for (int g = 0; g < PERF_N_GROUPS; g++)
+        {
+            if (pc->groups[g].leader == -1)
+                continue;
+            (void)ioctl(pc->groups[g].leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            opened++;
+        }
+    }
+    if (opened == 0)
+    {
+        M_ERROR(MODULE_NAME, "perf counters are not available (check perf_event_paranoid), disabled");
+        perf_close(perf);
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &perf->last);
+    perf->enabled = 1;
+    return 0;
+}
+
+static void group_read(perf_t *perf, perf_cpu_t *pc, perf_group_id_t g, int cpu, double elapsed)
+{
+    perf_group_t *group = &pc->groups[g];
+    uint64_t enabled, running, value, delta;
+    size_t size = (3 + group->n_events) * sizeof(uint64_t);
+    double scale;
+    if (group->leader == -1)
+        return;
+    if (read(group->leader, perf->rbuf, size) != (ssize_t)size)
+    {
+        M_ERROR(MODULE_NAME, "Unable to read perf counters of cpu%d: %s", cpu, strerror(errno));
+        return;
+    }
+    enabled = perf->rbuf[1] - group->last_enabled;
+    running = perf->rbuf[2] - group->last_running;
+    group->last_enabled = perf->rbuf[1];
+    group->last_running = perf->rbuf[2];
+    // extrapolate the interval when the group was multiplexed with other users of the PMU
+    scale = running > 0 && running < enabled ? (double)enabled / (double)running : 1.0;
+    for (int i = 0; i < PERF_N_COUNTERS; i++)
+    {
+        if (pc->index[i] < 0 || perf_events[i].group != g)
+            continue;
+        value = perf->rbuf[3 + pc->index[i]];
+        delta = value >= pc->last[i] ? value - pc->last[i] : 0;
+        pc->last[i] = value;
+        // a group that was not scheduled at all in the interval keeps its last rate
+        if (running > 0)
+            pc->rate[i] = (float)(delta * scale / elapsed);
+    }
+}
+
+int perf_read(perf_t *perf)
+{
+    struct timespec now;
+    double elapsed;
+    if (!perf->enabled)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - perf->last.tv_sec) + (now.tv_nsec - perf->last.tv_nsec) / 1.0e9;
+    perf->last = now;
+    if (elapsed <= 0.0)
+        return 0;
+    for (int cpu = 0; cpu < perf->n_cpus; cpu++)
+    {
+        for (int g = 0; g < PERF_N_GROUPS; g++)
+            group_read(perf, &perf->cpus[cpu], (perf_group_id_t)g, cpu, elapsed);
+    }
+    return 0;
+}
+
+void perf_encode(perf_t *perf, obuf_t *ob)
+{
+    int first = 1;
+    if (!perf->enabled)
+        return;
+    OBUF_LIT(ob, ",\"perf\":{");
+    for (int i = 0; i < PERF_N_COUNTERS; i++)
+    {
+        if (!perf->available[i])
+            continue;
+        if (!first)
+            obuf_putc(ob, ',');
+        first = 0;
+        obuf_putc(ob, '"');
+        obuf_puts(ob, perf_events[i].name);
+        OBUF_LIT(ob, "\":[");
+        for (int cpu = 0; cpu < perf->n_cpus; cpu++)
+        {
+            if (cpu > 0)
+                obuf_putc(ob, ',');
+            obuf_fixed(ob, perf->cpus[cpu].rate[i], 3);
+        }
+        obuf_putc(ob, ']');
+    }
+    obuf_putc(ob, '}');
+}
+
+void perf_close(perf_t *perf)
+{
+    if (perf->cpus)
+    {
+        for (int cpu = 0; cpu < perf->n_cpus; cpu++)
+        {
+            for (int i = 0; i < PERF_N_COUNTERS; i++)
+            {
+                if (perf->cpus[cpu].fds[i] >= 0)
+                    (void)close(perf->cpus[cpu].fds[i]);
+            }
+        }
+        free(perf->cpus);
+    }
+    if (perf->rbuf)
+        free(perf->rbuf);
+    perf->cpus = NULL;
+    perf->rbuf = NULL;
+    perf->enabled = 0;
+}
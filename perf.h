@@ -0,0 +1,63 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "obuf.h"
+
+typedef enum
+{
+    PERF_CONTEXT_SWITCHES = 0,
+    PERF_CPU_MIGRATIONS,
+    PERF_PAGE_FAULTS,
+    PERF_MAJOR_FAULTS,
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_N_COUNTERS
+} perf_counter_t;
+
+/*software counters always run, they are kept out of the PMU group so they are never multiplexed*/
+typedef enum
+{
+    PERF_GROUP_HW = 0,
+    PERF_GROUP_SW,
+    PERF_N_GROUPS
+} perf_group_id_t;
+
+typedef struct
+{
+    /*group leader, the whole group is read at once through it*/
+    int leader;
+    int n_events;
+    uint64_t last_enabled;
+    uint64_t last_running;
+} perf_group_t;
+
+typedef struct
+{
+    perf_group_t groups[PERF_N_GROUPS];
+    int fds[PERF_N_COUNTERS];
+    /*position of each counter in its group read, -1 if not available*/
+    int index[PERF_N_COUNTERS];
+    uint64_t last[PERF_N_COUNTERS];
+    float rate[PERF_N_COUNTERS];
+} perf_cpu_t;
+
+typedef struct
+{
+    int enabled;
+    int n_cpus;
+    perf_cpu_t *cpus;
+    /*counters opened on at least one CPU*/
+    int available[PERF_N_COUNTERS];
+    uint64_t *rbuf;
+    struct timespec last;
+} perf_t;
+
+int perf_open(perf_t *perf, int n_cpus);
+int perf_read(perf_t *perf);
+void perf_encode(perf_t *perf, obuf_t *ob);
+void perf_close(perf_t *perf);
+
+#endif
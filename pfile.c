@@ -0,0 +1,134 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "sysmon.h"
+#include "pfile.h"
+
+#define PFILE_MIN_CAP 512
+
+void pfile_init(pfile_t *pf)
+{
+    pf->fd = -1;
+    pf->data = NULL;
+    pf->len = 0;
+    pf->cap = 0;
+    pf->fixed = 0;
+    pf->truncated = 0;
+    pf->ready = 0;
+    pf->reads = 0;
+}
+
+int pfile_open(pfile_t *pf, const char *path)
+{
+    pf->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (pf->fd < 0)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    if (pf->cap == 0)
+    {
+        pf->data = (char *)malloc(PFILE_MIN_CAP);
+        if (!pf->data)
+        {
+            (void)close(pf->fd);
+            pf->fd = -1;
+            return -1;
+        }
+        pf->cap = PFILE_MIN_CAP;
+    }
+    pf->len = 0;
+    pf->data[0] = '\0';
+    return 0;
+}
+
+/**
+ * Read the file content from the start, stop after max_lines complete
+ * lines (0: whole file) so only the head of big proc files is copied and parsed.
+ * The content is NUL terminated, return its length or -1 on error.
+ * Content prefetched by a batch is returned as is
+ */
+ssize_t pfile_read(pfile_t *pf, int max_lines)
+{
+    ssize_t ret;
+    int lines = 0;
+    char *ptr;
+    if (pf->fd < 0)
+        return -1;
+    if (pf->ready)
+    {
+        pf->ready = 0;
+        return (ssize_t)pf->len;
+    }
+    pf->len = 0;
+    pf->truncated = 0;
+    while (1)
+    {
+        if (pf->fixed && pf->len + 1 >= pf->cap)
+        {
+            // the buffer cannot grow: keep what fits and let the owner know
+            pf->truncated = 1;
+            break;
+        }
+        if (!pf->fixed && pf->cap - pf->len < PFILE_MIN_CAP)
+        {
+            ptr = (char *)realloc(pf->data, pf->cap * 2);
+            if (!ptr)
+                return -1;
+            pf->data = ptr;
+            pf->cap *= 2;
+        }
+        pf->reads++;
+        ret = pread(pf->fd, pf->data + pf->len, pf->cap - pf->len - 1, (off_t)pf->len);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (ret == 0)
+            break;
+        if (max_lines > 0)
+        {
+            ptr = pf->data + pf->len;
+            while ((ptr = memchr(ptr, '\n', pf->data + pf->len + ret - ptr)) != NULL)
+            {
+                lines++;
+                ptr++;
+            }
+        }
+        pf->len += (size_t)ret;
+        if (max_lines > 0 && lines >= max_lines)
+            break;
+    }
+    pf->data[pf->len] = '\0';
+    return (ssize_t)pf->len;
+}
+
+int pfile_freeze(pfile_t *pf, size_t cap)
+{
+    char *ptr;
+    if (pf->fixed)
+        return 0;
+    pf->fixed = 1;
+    if (cap <= pf->cap)
+        return 0;
+    ptr = (char *)realloc(pf->data, cap);
+    if (!ptr)
+        return -1;
+    pf->data = ptr;
+    pf->cap = cap;
+    return 0;
+}
+
+void pfile_close(pfile_t *pf)
+{
+    if (pf->fd >= 0)
+        (void)close(pf->fd);
+    if (pf->data)
+        free(pf->data);
+    pfile_init(pf);
+}
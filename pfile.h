@@ -0,0 +1,35 @@
+#ifndef PFILE_H
+#define PFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * procfs/sysfs file kept open between samples and re-read from
+ * offset 0 with pread, into a buffer that only grows
+ */
+typedef struct
+{
+    int fd;
+    char *data;
+    size_t len;
+    size_t cap;
+    /*the buffer must not move or grow (registered with io_uring, or real-time mode)*/
+    int fixed;
+    /*the last read filled a fixed buffer, the content was cut*/
+    int truncated;
+    /*data was already read by a batch (see uring.c), consumed by the next pfile_read*/
+    int ready;
+    /*pread calls made so far*/
+    uint64_t reads;
+} pfile_t;
+
+void pfile_init(pfile_t *pf);
+int pfile_open(pfile_t *pf, const char *path);
+ssize_t pfile_read(pfile_t *pf, int max_lines);
+/*grow the buffer to at least cap bytes, then never move or grow it*/
+int pfile_freeze(pfile_t *pf, size_t cap);
+void pfile_close(pfile_t *pf);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <dirent.h>
+#include <fcntl.h>
+
+#include "power.h"
+
+#define POWERCAP_DIR "%s/sys/class/powercap"
+
+static int read_small_file(const char *path, char *data, size_t size)
+{
+    ssize_t ret;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ret = read(fd, data, size - 1);
+    (void)close(fd);
+    if (ret <= 0)
+        return -1;
+    data[ret] = '\0';
+    // strip the trailing new line
+    data[strcspn(data, "\n")] = '\0';
+    return 0;
+}
+
+static int zone_cmp(const void *a, const void *b)
+{
+    return strcmp(((const power_zone_t *)a)->id, ((const power_zone_t *)b)->id);
+}
+
+/**
+ * Discover the powercap zones exposing an energy counter
+ * (intel-rapl:*, amd-rapl ... but not the control type directories)
+ * and keep their energy_uj files open
+ */
+int power_open(power_t *power, const char *root_dir)
+{
+    char dir_path[MAX_BUF * 2];
+    char path[MAX_BUF * 3];
+    char data[64];
+    DIR *dir;
+    struct dirent *ent;
+    power_zone_t *zone;
+    power->n_zones = 0;
+    (void)snprintf(dir_path, sizeof(dir_path), POWERCAP_DIR, root_dir);
+    dir = opendir(dir_path);
+    if (dir == NULL)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open %s: %s", dir_path, strerror(errno));
+        return -1;
+    }
+    while ((ent = readdir(dir)) != NULL && power->n_zones < POWER_MAX_ZONES)
+    {
+        if (ent->d_name[0] == '.' || strlen(ent->d_name) >= sizeof(zone->id))
+            continue;
+        zone = &power->zones[power->n_zones];
+        (void)memset(zone, 0, sizeof(*zone));
+        pfile_init(&zone->energy);
+        (void)snprintf(path, sizeof(path), "%s/%s/max_energy_range_uj", dir_path, ent->d_name);
+        if (read_small_file(path, data, sizeof(data)) == -1)
+            continue;
+        zone->max_range = strtoull(data, NULL, 10);
+        (void)snprintf(path, sizeof(path), "%s/%s/energy_uj", dir_path, ent->d_name);
+        // energy_uj is only readable by root on recent kernels
+        if (pfile_open(&zone->energy, path) == -1)
+            continue;
+        (void)strcpy(zone->id, ent->d_name);
+        (void)snprintf(path, sizeof(path), "%s/%s/name", dir_path, ent->d_name);
+        if (read_small_file(path, data, sizeof(data)) == -1)
+            (void)strcpy(data, zone->id);
+        (void)snprintf(zone->name, sizeof(zone->name), "%s", data);
+        // intel-rapl:0 is a package, intel-rapl:0:0 one of its sub zones
+        zone->top = strchr(zone->id, ':') == strrchr(zone->id, ':');
+        power->n_zones++;
+    }
+    (void)closedir(dir);
+    // readdir order is arbitrary, keep the output stable
+    qsort(power->zones, power->n_zones, sizeof(power->zones[0]), zone_cmp);
+    M_LOG(MODULE_NAME, "Found %d powercap zones", power->n_zones);
+    return power->n_zones > 0 ? 0 : -1;
+}
+
+/*average power of each zone since the previous call*/
+int power_read(power_t *power)
+{
+    struct timespec now;
+    double elapsed;
+    uint64_t energy, delta;
+    power_zone_t *zone;
+    int ret = 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - power->last.tv_sec) + (now.tv_nsec - power->last.tv_nsec) / 1.0e9;
+    power->last = now;
+    for (int i = 0; i < power->n_zones; i++)
+    {
+        zone = &power->zones[i];
+        if (pfile_read(&zone->energy, 0) <= 0)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read energy of %s: %s", zone->id, strerror(errno));
+            zone->watts = NAN;
+            ret = -1;
+            continue;
+        }
+        energy = strtoull(zone->energy.data, NULL, 10);
+        if (!zone->primed || elapsed <= 0.0)
+        {
+            zone->watts = NAN;
+        }
+        else
+        {
+            // the counter wraps around at max_energy_range_uj
+            if (energy >= zone->last)
+                delta = energy - zone->last;
+            else
+                delta = zone->max_range - zone->last + energy;
+            zone->watts = delta / 1.0e6 / elapsed;
+        }
+        zone->last = energy;
+        zone->primed = 1;
+    }
+    return ret;
+}
+
+/*psys (platform) already includes the packages, it only stands for the total when no package is read*/
+static int is_psys(const power_zone_t *zone)
+{
+    return strcmp(zone->name, "psys") == 0;
+}
+
+/*sum of the top level zones, NaN if none is available*/
+double power_total(power_t *power)
+{
+    double total = NAN, psys = NAN;
+    for (int i = 0; i < power->n_zones; i++)
+    {
+        if (!power->zones[i].top || isnan(power->zones[i].watts))
+            continue;
+        if (is_psys(&power->zones[i]))
+            psys = isnan(psys) ? power->zones[i].watts : psys + power->zones[i].watts;
+        else
+            total = isnan(total) ? power->zones[i].watts : total + power->zones[i].watts;
+    }
+    return isnan(total) ? psys : total;
+}
+
+void power_encode(power_t *power, obuf_t *ob)
+{
+    if (power->n_zones == 0)
+        return;
+    OBUF_LIT(ob, ",\"power\":[");
+    for (int i = 0; i < power->n_zones; i++)
+    {
+        if (i > 0)
+            obuf_putc(ob, ',');
+        OBUF_LIT(ob, "{\"zone\":\"");
+        obuf_puts(ob, power->zones[i].id);
+        OBUF_LIT(ob, "\",\"name\":\"");
+        obuf_puts(ob, power->zones[i].name);
+        OBUF_LIT(ob, "\",\"watts\": ");
+        if (isnan(power->zones[i].watts))
+            OBUF_LIT(ob, "null");
+        else
+            obuf_fixed(ob, power->zones[i].watts, 3);
+        obuf_putc(ob, '}');
+    }
+    obuf_putc(ob, ']');
+}
+
+void power_close(power_t *power)
+{
+    for (int i = 0; i < power->n_zones; i++)
+    {
+        pfile_close(&power->zones[i].energy);
+    }
+    power->n_zones = 0;
+}
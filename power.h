@@ -0,0 +1,42 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "pfile.h"
+
+#define POWER_MAX_ZONES 32
+
+typedef struct
+{
+    /*powercap zone directory, e.g. intel-rapl:0:1*/
+    char id[32];
+    /*content of the zone name file, e.g. package-0, dram*/
+    char name[64];
+    /*top level zone, the sub zones are included in their parent*/
+    int top;
+    pfile_t energy;
+    uint64_t max_range;
+    uint64_t last;
+    int primed;
+    double watts;
+} power_zone_t;
+
+typedef struct
+{
+    int enabled;
+    int n_zones;
+    power_zone_t zones[POWER_MAX_ZONES];
+    struct timespec last;
+} power_t;
+
+int power_open(power_t *power, const char *root_dir);
+int power_read(power_t *power);
+double power_total(power_t *power);
+void power_encode(power_t *power, obuf_t *ob);
+void power_close(power_t *power);
+
+#endif
@@ -0,0 +1,538 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "history.h"
+
+#define MAX_QUERY_METRICS 64
+#define MAX_PERCENTILES 16
+/*independent accumulators, the compiler maps them on vector registers*/
+#define LANES 8
+
+typedef struct
+{
+    char name[32];
+    uint64_t n;
+    double sum;
+    double min;
+    double max;
+    /*values kept for the percentiles*/
+    double *values;
+    size_t n_values;
+    size_t cap;
+} query_agg_t;
+
+typedef struct
+{
+    char dir[MAX_BUF];
+    int64_t from;
+    int64_t to;
+    int n_metrics;
+    query_agg_t aggs[MAX_QUERY_METRICS];
+    int n_percentiles;
+    double percentiles[MAX_PERCENTILES];
+    /*optional row filter: where_metric > where_value (sign 1) or < (sign -1), or equal when where_incl*/
+    char where_metric[32];
+    double where_value;
+    double where_sign;
+    int where_incl;
+    int segments;
+    int skipped;
+} query_t;
+
+static void help(const char *app)
+{
+    fprintf(stderr,
+            "Usage: %s -d dir [-m metrics] [-f from] [-t to] [-w filter] [-p percentiles | -n]\n"
+            "Options:\n"
+            "\t -d <value>: history directory (history_dir of sysmond)\n"
+            "\t -m <value>: comma separated metrics, e.g. cpu_temp,cpu_usage (default: all)\n"
+            "\t -f <value>: start time, unix seconds or relative to now: 30m, 12h, 7d\n"
+            "\t -t <value>: end time, same format as -f\n"
+            "\t -w <value>: only aggregate the rows matching metric>value, metric>=value, metric<value or metric<=value\n"
+            "\t -p <value>: comma separated percentiles (default: 50,95,99)\n"
+            "\t -n: no percentiles, the values are not kept in memory\n"
+            "\t -h: this help message\n",
+            app);
+}
+
+static int64_t parse_time(const char *value)
+{
+    char *end = NULL;
+    long long t = strtoll(value, &end, 10);
+    long long unit = 0;
+    switch (end ? *end : '\0')
+    {
+    case 's':
+        unit = 1;
+        break;
+    case 'm':
+        unit = 60;
+        break;
+    case 'h':
+        unit = 3600;
+        break;
+    case 'd':
+        unit = 86400;
+        break;
+    default:
+        return (int64_t)t * 1000000;
+    }
+    return ((int64_t)time(NULL) - t * unit) * 1000000;
+}
+
+static int parse_where(query_t *q, const char *value)
+{
+    const char *op = strpbrk(value, "<>");
+    size_t len;
+    if (op == NULL)
+        return -1;
+    len = (size_t)(op - value);
+    if (len == 0 || len >= sizeof(q->where_metric))
+        return -1;
+    (void)memcpy(q->where_metric, value, len);
+    q->where_metric[len] = '\0';
+    q->where_sign = *op == '>' ? 1.0 : -1.0;
+    q->where_incl = op[1] == '=';
+    q->where_value = atof(op + 1 + q->where_incl);
+    return 0;
+}
+
+static int add_metric(query_t *q, const char *name)
+{
+    query_agg_t *agg;
+    for (int i = 0; i < q->n_metrics; i++)
+    {
+        if (strcmp(q->aggs[i].name, name) == 0)
+            return 0;
+    }
+    if (q->n_metrics >= MAX_QUERY_METRICS)
+        return -1;
+    agg = &q->aggs[q->n_metrics++];
+    (void)memset(agg, 0, sizeof(*agg));
+    (void)snprintf(agg->name, sizeof(agg->name), "%s", name);
+    agg->min = INFINITY;
+    agg->max = -INFINITY;
+    return 0;
+}
+
+static int keep_values(query_agg_t *agg, size_t n)
+{
+    double *values;
+    size_t cap = agg->cap ? agg->cap : 4096;
+    if (agg->n_values + n <= agg->cap)
+        return 0;
+    while (cap < agg->n_values + n)
+        cap *= 2;
+    values = (double *)realloc(agg->values, cap * sizeof(double));
+    if (values == NULL)
+        return -1;
+    agg->values = values;
+    agg->cap = cap;
+    return 0;
+}
+
+/**
+ * aggregate x[0..n) over the rows where sign * w[i] > sign * t (or >= when incl).
+ * Without filter w is x and t is -inf, NaN values never pass
+ */
+static int aggregate(query_agg_t *agg, const double *x, const double *w, double t, double sign, int incl, size_t n,
+                     int keep)
+{
+    double sum[LANES], min[LANES], max[LANES];
+    uint64_t count[LANES];
+    size_t i = 0;
+    t *= sign;
+    for (int l = 0; l < LANES; l++)
+    {
+        sum[l] = 0.0;
+        min[l] = INFINITY;
+        max[l] = -INFINITY;
+        count[l] = 0;
+    }
+    for (; i + LANES <= n; i += LANES)
+    {
+        for (int l = 0; l < LANES; l++)
+        {
+            double v = x[i + l];
+            int ok = (v == v) & ((sign * w[i + l] > t) | (incl & (sign * w[i + l] == t)));
+            sum[l] += ok ? v : 0.0;
+            count[l] += ok;
+            min[l] = ok && v < min[l] ? v : min[l];
+            max[l] = ok && v > max[l] ? v : max[l];
+        }
+    }
+    for (; i < n; i++)
+    {
+        double v = x[i];
+        int ok = (v == v) & ((sign * w[i] > t) | (incl & (sign * w[i] == t)));
+        sum[0] += ok ? v : 0.0;
+        count[0] += ok;
+        min[0] = ok && v < min[0] ? v : min[0];
+        max[0] = ok && v > max[0] ? v : max[0];
+    }
+    for (int l = 0; l < LANES; l++)
+    {
+        agg->sum += sum[l];
+        agg->n += count[l];
+        agg->min = min[l] < agg->min ? min[l] : agg->min;
+        agg->max = max[l] > agg->max ? max[l] : agg->max;
+    }
+    if (!keep)
+        return 0;
+    if (keep_values(agg, n) == -1)
+        return -1;
+    for (i = 0; i < n; i++)
+    {
+        agg->values[agg->n_values] = x[i];
+        agg->n_values += (x[i] == x[i]) & ((sign * w[i] > t) | (incl & (sign * w[i] == t)));
+    }
+    return 0;
+}
+
+/*first row with stamp >= t*/
+static size_t lower_bound(const int64_t *stamps, size_t n, int64_t t)
+{
+    size_t lo = 0, hi = n;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (stamps[mid] < t)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static const history_column_t *find_column(const history_column_t *desc, int n_cols, const char *name)
+{
+    for (int i = 0; i < n_cols; i++)
+    {
+        if (strncmp(desc[i].name, name, sizeof(desc[i].name)) == 0)
+            return &desc[i];
+    }
+    return NULL;
+}
+
+/*zone map test: 1 if no row of the column can pass the filter*/
+static int zone_excludes(const query_t *q, const history_column_t *col)
+{
+    if (col == NULL || col->n_valid == 0)
+        return 1;
+    if (q->where_sign > 0)
+        return !(col->max > q->where_value || (q->where_incl && col->max == q->where_value));
+    return !(col->min < q->where_value || (q->where_incl && col->min == q->where_value));
+}
+
+static int scan_segment(query_t *q, const char *path)
+{
+    history_header_t header;
+    history_column_t *desc = NULL;
+    const history_column_t *where = NULL;
+    const char *base = NULL;
+    const int64_t *stamps;
+    size_t lo, hi, desc_size;
+    struct stat st;
+    int fd, keep = q->n_percentiles > 0, ret = -1;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1)
+        goto end;
+    // the header and the zone maps decide whether the columns are touched at all
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, HISTORY_MAGIC, sizeof(header.magic)) != 0 || header.version != HISTORY_VERSION)
+    {
+        fprintf(stderr, "%s: not a history segment\n", path);
+        goto end;
+    }
+    q->segments++;
+    if (header.n_rows == 0 || header.t_max < q->from || header.t_min > q->to)
+    {
+        q->skipped++;
+        ret = 0;
+        goto end;
+    }
+    desc_size = header.n_cols * sizeof(history_column_t);
+    desc = (history_column_t *)malloc(desc_size);
+    if (desc == NULL || pread(fd, desc, desc_size, sizeof(header)) != (ssize_t)desc_size)
+        goto end;
+    if (q->where_metric[0] != '\0')
+    {
+        where = find_column(desc, header.n_cols, q->where_metric);
+        if (zone_excludes(q, where))
+        {
+            q->skipped++;
+            ret = 0;
+            goto end;
+        }
+    }
+    if (header.stamp_offset + header.n_rows * sizeof(int64_t) > (uint64_t)st.st_size)
+        goto invalid;
+    for (int i = 0; i < (int)header.n_cols; i++)
+    {
+        if (desc[i].offset + header.n_rows * sizeof(double) > (uint64_t)st.st_size)
+            goto invalid;
+    }
+    // pages of the columns that are not queried are never read
+    base = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        base = NULL;
+        goto end;
+    }
+    stamps = (const int64_t *)(base + header.stamp_offset);
+    lo = header.t_min >= q->from ? 0 : lower_bound(stamps, header.n_rows, q->from);
+    hi = header.t_max <= q->to ? header.n_rows : lower_bound(stamps, header.n_rows, q->to + 1);
+    for (int i = 0; i < q->n_metrics && lo < hi; i++)
+    {
+        const history_column_t *col = find_column(desc, header.n_cols, q->aggs[i].name);
+        const double *x, *w;
+        if (col == NULL || col->n_valid == 0)
+            continue;
+        x = (const double *)(base + col->offset);
+        if (where)
+        {
+            w = (const double *)(base + where->offset);
+            if (aggregate(&q->aggs[i], x + lo, w + lo, q->where_value, q->where_sign, q->where_incl, hi - lo, keep) == -1)
+                goto end;
+        }
+        else if (aggregate(&q->aggs[i], x + lo, x + lo, -INFINITY, 1.0, 0, hi - lo, keep) == -1)
+        {
+            goto end;
+        }
+    }
+    ret = 0;
+    goto end;
+invalid:
+    fprintf(stderr, "%s: truncated segment\n", path);
+end:
+    if (base)
+        (void)munmap((void *)base, st.st_size);
+    if (fd != -1)
+        (void)close(fd);
+    free(desc);
+    return ret;
+}
+
+static void swap(double *a, double *b)
+{
+    double t = *a;
+    *a = *b;
+    *b = t;
+}
+
+/*partition a[lo..hi] so that a[k] is the k-th smallest value*/
+static void select_kth(double *a, size_t lo, size_t hi, size_t k)
+{
+    while (hi > lo)
+    {
+        size_t mid = lo + (hi - lo) / 2, i = lo, j = hi;
+        double pivot;
+        if (a[mid] < a[lo])
+            swap(&a[mid], &a[lo]);
+        if (a[hi] < a[lo])
+            swap(&a[hi], &a[lo]);
+        if (a[hi] < a[mid])
+            swap(&a[hi], &a[mid]);
+        pivot = a[mid];
+        while (i <= j)
+        {
+            while (a[i] < pivot)
+                i++;
+            while (a[j] > pivot)
+                j--;
+            if (i <= j)
+            {
+                swap(&a[i], &a[j]);
+                i++;
+                if (j == 0)
+                    break;
+                j--;
+            }
+        }
+        if (k <= j)
+            hi = j;
+        else if (k >= i)
+            lo = i;
+        else
+            return;
+    }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void print_value(const char *key, double value)
+{
+    if (isfinite(value))
+        printf(",\"%s\": %.3f", key, value);
+    else
+        printf(",\"%s\": null", key);
+}
+
+static void report(query_t *q)
+{
+    char key[16];
+    qsort(q->percentiles, q->n_percentiles, sizeof(double), cmp_double);
+    for (int i = 0; i < q->n_metrics; i++)
+    {
+        query_agg_t *agg = &q->aggs[i];
+        size_t lo = 0;
+        printf("{\"metric\":\"%s\",\"rows\": %llu", agg->name, (unsigned long long)agg->n);
+        print_value("avg", agg->n ? agg->sum / agg->n : NAN);
+        print_value("min", agg->min);
+        print_value("max", agg->max);
+        // ascending ranks: each selection only partitions what is right of the previous one
+        for (int j = 0; j < q->n_percentiles; j++)
+        {
+            double value = NAN;
+            if (agg->n_values > 0)
+            {
+                size_t k = (size_t)(q->percentiles[j] / 100.0 * (agg->n_values - 1) + 0.5);
+                select_kth(agg->values, lo, agg->n_values - 1, k);
+                value = agg->values[k];
+                lo = k;
+            }
+            (void)snprintf(key, sizeof(key), "p%g", q->percentiles[j]);
+            print_value(key, value);
+        }
+        printf(",\"segments\": %d,\"skipped\": %d}\n", q->segments, q->skipped);
+    }
+}
+
+static int seg_filter(const struct dirent *entry)
+{
+    size_t len = strlen(entry->d_name);
+    return strncmp(entry->d_name, "seg-", 4) == 0 && len > 8 && strcmp(entry->d_name + len - 4, ".col") == 0;
+}
+
+int main(int argc, char *const *argv)
+{
+    query_t q;
+    struct dirent **entries = NULL;
+    char path[MAX_BUF * 2];
+    char metrics[MAX_BUF * 4];
+    char *token, *saveptr;
+    int ret, n, status = 0, percentiles = 1;
+    (void)memset(&q, 0, sizeof(q));
+    q.from = INT64_MIN;
+    q.to = INT64_MAX;
+    metrics[0] = '\0';
+    while ((ret = getopt(argc, argv, "hnd:m:f:t:w:p:")) != -1)
+    {
+        switch (ret)
+        {
+        case 'd':
+            (void)snprintf(q.dir, sizeof(q.dir), "%s", optarg);
+            break;
+        case 'm':
+            (void)snprintf(metrics, sizeof(metrics), "%s", optarg);
+            break;
+        case 'f':
+            q.from = parse_time(optarg);
+            break;
+        case 't':
+            q.to = parse_time(optarg);
+            break;
+        case 'w':
+            if (parse_where(&q, optarg) == -1)
+            {
+                fprintf(stderr, "Invalid filter: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'p':
+            q.n_percentiles = 0;
+            for (token = strtok_r(optarg, ",", &saveptr); token && q.n_percentiles < MAX_PERCENTILES;
+                 token = strtok_r(NULL, ",", &saveptr))
+            {
+                double p = atof(token);
+                if (p >= 0.0 && p <= 100.0)
+                    q.percentiles[q.n_percentiles++] = p;
+            }
+            break;
+        case 'n':
+            percentiles = 0;
+            break;
+        default:
+            help(argv[0]);
+            return 1;
+        }
+    }
+    if (q.dir[0] == '\0')
+    {
+        help(argv[0]);
+        return 1;
+    }
+    if (!percentiles)
+    {
+        q.n_percentiles = 0;
+    }
+    else if (q.n_percentiles == 0)
+    {
+        q.percentiles[0] = 50.0;
+        q.percentiles[1] = 95.0;
+        q.percentiles[2] = 99.0;
+        q.n_percentiles = 3;
+    }
+    n = scandir(q.dir, &entries, seg_filter, alphasort);
+    if (n < 0)
+    {
+        fprintf(stderr, "Unable to list %s: %s\n", q.dir, strerror(errno));
+        return 1;
+    }
+    for (token = strtok_r(metrics, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr))
+        (void)add_metric(&q, token);
+    for (int i = 0; i < n; i++)
+    {
+        (void)snprintf(path, sizeof(path), "%s/%s", q.dir, entries[i]->d_name);
+        if (q.n_metrics == 0)
+        {
+            // all the metrics of the first segment
+            history_header_t header;
+            history_column_t col;
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd != -1 && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                memcmp(header.magic, HISTORY_MAGIC, sizeof(header.magic)) == 0)
+            {
+                for (uint32_t j = 0; j < header.n_cols; j++)
+                {
+                    if (pread(fd, &col, sizeof(col), sizeof(header) + j * sizeof(col)) == (ssize_t)sizeof(col))
+                        (void)add_metric(&q, col.name);
+                }
+            }
+            if (fd != -1)
+                (void)close(fd);
+        }
+        // segments are named after their first stamp, the rest are all later
+        if (strtoll(entries[i]->d_name + 4, NULL, 10) > q.to)
+        {
+            q.segments++;
+            q.skipped++;
+        }
+        else if (scan_segment(&q, path) == -1)
+        {
+            fprintf(stderr, "Unable to read %s: %s\n", path, strerror(errno));
+            status = 1;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    report(&q);
+    for (int i = 0; i < q.n_metrics; i++)
+        free(q.aggs[i].values);
+    return status;
+}
@@ -0,0 +1,231 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+#include "sysmon.h"
+#include "rt.h"
+
+/*stack touched before locking, so the sampling path never faults on it*/
+#define RT_STACK_PREFAULT (256 * 1024)
+
+static void parse_cpus(rt_t *rt, const char *value)
+{
+    const char *ptr = value;
+    char *end;
+    long first, last;
+    rt->n_cpus = 0;
+    while (*ptr != '\0' && rt->n_cpus < RT_MAX_CPUS)
+    {
+        first = strtol(ptr, &end, 10);
+        if (end == ptr)
+        {
+            ptr++;
+            continue;
+        }
+        last = first;
+        ptr = end;
+        if (*ptr == '-')
+        {
+            last = strtol(ptr + 1, &end, 10);
+            ptr = end;
+        }
+        for (long cpu = first; cpu <= last && rt->n_cpus < RT_MAX_CPUS; cpu++)
+            rt->cpus[rt->n_cpus++] = (int)cpu;
+    }
+}
+
+int rt_config(rt_t *rt, const char *name, const char *value)
+{
+    if (EQU(name, "realtime"))
+    {
+        rt->enabled = atoi(value);
+    }
+    else if (EQU(name, "realtime_priority"))
+    {
+        rt->priority = atoi(value);
+    }
+    else if (EQU(name, "realtime_cpus"))
+    {
+        parse_cpus(rt, value);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static void prefault_stack(void)
+{
+    volatile char stack[RT_STACK_PREFAULT];
+    for (size_t i = 0; i < sizeof(stack); i += 4096)
+        stack[i] = 0;
+}
+
+/**
+ * Switch the calling process to the low jitter mode: lock and pre-fault
+ * memory, keep freed heap memory mapped, then apply the CPU affinity and
+ * the SCHED_FIFO priority. Each step failing is logged and skipped
+ */
+int rt_enter(rt_t *rt)
+{
+    int ret = 0, locked = 0, pinned = 0, fifo = 0;
+    struct sched_param param;
+    if (!rt->enabled)
+        return 0;
+    // freed memory stays in the (locked) heap instead of being trimmed or unmapped
+    (void)mallopt(M_TRIM_THRESHOLD, -1);
+    (void)mallopt(M_MMAP_MAX, 0);
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to lock memory: %s", strerror(errno));
+        ret = -1;
+    }
+    else
+    {
+        locked = 1;
+    }
+    prefault_stack();
+    if (rt->n_cpus > 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int i = 0; i < rt->n_cpus; i++)
+            CPU_SET(rt->cpus[i], &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to set CPU affinity: %s", strerror(errno));
+            ret = -1;
+        }
+        else
+        {
+            pinned = rt->n_cpus;
+        }
+    }
+    if (rt->priority > 0)
+    {
+        (void)memset(&param, 0, sizeof(param));
+        param.sched_priority = rt->priority;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to set SCHED_FIFO priority %d: %s", rt->priority, strerror(errno));
+            ret = -1;
+        }
+        else
+        {
+            fifo = rt->priority;
+        }
+    }
+    if (!locked && !pinned && !fifo)
+    {
+        M_ERROR(MODULE_NAME, "Real-time mode: no step succeeded, sampling runs as a normal process");
+        return -1;
+    }
+    M_LOG(MODULE_NAME, "Real-time mode: memory %s, SCHED_FIFO priority %d, %d pinned CPU(s)",
+          locked ? "locked" : "not locked", fifo, pinned);
+    return ret;
+}
+
+static void timespec_add_ns(struct timespec *ts, uint64_t ns)
+{
+    ns += (uint64_t)ts->tv_nsec;
+    ts->tv_sec += (time_t)(ns / 1000000000ULL);
+    ts->tv_nsec = (long)(ns % 1000000000ULL);
+}
+
+/*must be called right after the timer is armed*/
+void rt_jitter_start(rt_jitter_t *jitter, const struct itimerspec *period)
+{
+    int enabled = jitter->enabled;
+    (void)memset(jitter, 0, sizeof(*jitter));
+    jitter->enabled = enabled;
+    jitter->period_ns = (uint64_t)period->it_interval.tv_sec * 1000000000ULL + (uint64_t)period->it_interval.tv_nsec;
+    clock_gettime(CLOCK_MONOTONIC, &jitter->deadline);
+    timespec_add_ns(&jitter->deadline, (uint64_t)period->it_value.tv_sec * 1000000000ULL + (uint64_t)period->it_value.tv_nsec);
+    jitter->min_ns = INT64_MAX;
+}
+
+/*follow a timer re-armed with a new period, keeping the statistics*/
+void rt_jitter_rebase(rt_jitter_t *jitter, const struct itimerspec *period)
+{
+    jitter->period_ns = (uint64_t)period->it_interval.tv_sec * 1000000000ULL + (uint64_t)period->it_interval.tv_nsec;
+    clock_gettime(CLOCK_MONOTONIC, &jitter->deadline);
+    timespec_add_ns(&jitter->deadline, (uint64_t)period->it_value.tv_sec * 1000000000ULL + (uint64_t)period->it_value.tv_nsec);
+}
+
+/*record the wakeup latency of the timer read that reported n expirations*/
+void rt_jitter_update(rt_jitter_t *jitter, uint64_t expirations)
+{
+    struct timespec now;
+    int64_t latency;
+    size_t bucket;
+    if (!jitter->enabled || expirations == 0)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    // the latest expiration is the one that woke us up
+    timespec_add_ns(&jitter->deadline, (expirations - 1) * jitter->period_ns);
+    latency = (int64_t)(now.tv_sec - jitter->deadline.tv_sec) * 1000000000LL + (now.tv_nsec - jitter->deadline.tv_nsec);
+    timespec_add_ns(&jitter->deadline, jitter->period_ns);
+    if (latency < 0)
+        latency = 0;
+    jitter->last_ns = latency;
+    if (latency < jitter->min_ns)
+        jitter->min_ns = latency;
+    if (latency > jitter->max_ns)
+        jitter->max_ns = latency;
+    jitter->sum_ns += (double)latency;
+    jitter->count++;
+    bucket = (size_t)(latency / RT_HIST_STEP_NS);
+    if (bucket >= RT_HIST_BUCKETS)
+        bucket = RT_HIST_BUCKETS - 1;
+    jitter->hist[bucket]++;
+}
+
+static int64_t percentile_ns(rt_jitter_t *jitter, double pct)
+{
+    uint64_t rank = (uint64_t)(jitter->count * pct / 100.0);
+    uint64_t seen = 0;
+    for (int i = 0; i < RT_HIST_BUCKETS; i++)
+    {
+        seen += jitter->hist[i];
+        if (seen > rank)
+        {
+            // upper bound of the bucket, never above the observed maximum
+            int64_t bound = (int64_t)(i + 1) * RT_HIST_STEP_NS;
+            return (i < RT_HIST_BUCKETS - 1 && bound < jitter->max_ns) ? bound : jitter->max_ns;
+        }
+    }
+    return jitter->max_ns;
+}
+
+void rt_jitter_encode(rt_jitter_t *jitter, obuf_t *ob)
+{
+    if (!jitter->enabled)
+        return;
+    OBUF_LIT(ob, ",\"jitter\":{\"last_us\": ");
+    obuf_fixed(ob, jitter->last_ns / 1000.0, 3);
+    OBUF_LIT(ob, ",\"min_us\": ");
+    obuf_fixed(ob, jitter->count ? jitter->min_ns / 1000.0 : 0.0, 3);
+    OBUF_LIT(ob, ",\"avg_us\": ");
+    obuf_fixed(ob, jitter->count ? jitter->sum_ns / jitter->count / 1000.0 : 0.0, 3);
+    OBUF_LIT(ob, ",\"p99_us\": ");
+    obuf_fixed(ob, jitter->count ? percentile_ns(jitter, 99.0) / 1000.0 : 0.0, 3);
+    OBUF_LIT(ob, ",\"max_us\": ");
+    obuf_fixed(ob, jitter->max_ns / 1000.0, 3);
+    OBUF_LIT(ob, ",\"samples\": ");
+    obuf_u64(ob, jitter->count);
+    obuf_putc(ob, '}');
+}
+
+void rt_jitter_log(rt_jitter_t *jitter)
+{
+    if (!jitter->enabled || jitter->count == 0)
+        return;
+    M_LOG(MODULE_NAME, "Wakeup jitter over %lu samples: min %.3f us, avg %.3f us, p99 %.3f us, max %.3f us",
+          (unsigned long)jitter->count, jitter->min_ns / 1000.0, jitter->sum_ns / jitter->count / 1000.0,
+          percentile_ns(jitter, 99.0) / 1000.0, jitter->max_ns / 1000.0);
+}
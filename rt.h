@@ -0,0 +1,45 @@
+#ifndef RT_H
+#define RT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "obuf.h"
+
+#define RT_MAX_CPUS 64
+/*wakeup latency histogram: 10us buckets up to 10ms, the last one counts the overflow*/
+#define RT_HIST_STEP_NS 10000
+#define RT_HIST_BUCKETS 1001
+
+typedef struct
+{
+    int enabled;
+    int priority;
+    int n_cpus;
+    int cpus[RT_MAX_CPUS];
+} rt_t;
+
+typedef struct
+{
+    int enabled;
+    uint64_t period_ns;
+    /*expected time of the next timer expiration*/
+    struct timespec deadline;
+    uint64_t count;
+    int64_t last_ns;
+    int64_t min_ns;
+    int64_t max_ns;
+    double sum_ns;
+    uint32_t hist[RT_HIST_BUCKETS];
+} rt_jitter_t;
+
+int rt_config(rt_t *rt, const char *name, const char *value);
+int rt_enter(rt_t *rt);
+
+void rt_jitter_start(rt_jitter_t *jitter, const struct itimerspec *period);
+void rt_jitter_rebase(rt_jitter_t *jitter, const struct itimerspec *period);
+void rt_jitter_update(rt_jitter_t *jitter, uint64_t expirations);
+void rt_jitter_encode(rt_jitter_t *jitter, obuf_t *ob);
+void rt_jitter_log(rt_jitter_t *jitter);
+
+#endif
@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "schedstat.h"
+
+/*cpuN yld_count legacy sched_count sched_goidle ttwu_count ttwu_local rq_cpu_time run_delay pcount*/
+#define SCHEDSTAT_FIELDS 9
+#define SCHEDSTAT_RUN_DELAY 7
+#define SCHEDSTAT_PCOUNT 8
+
+static inline char *skip_spaces(char *ptr)
+{
+    // counters are padded to a fixed width, skip the padding 4 bytes at a time
+    while (ptr[0] == ' ' && ptr[1] == ' ' && ptr[2] == ' ' && ptr[3] == ' ')
+        ptr += 4;
+    while (*ptr == ' ' || *ptr == '\t')
+        ptr++;
+    return ptr;
+}
+
+/*parse an unsigned decimal, return 0 if there is none at ptr*/
+static inline int parse_u64(char **pptr, uint64_t *value)
+{
+    char *ptr = skip_spaces(*pptr);
+    uint64_t v = 0;
+    if (*ptr < '0' || *ptr > '9')
+        return 0;
+    while (*ptr >= '0' && *ptr <= '9')
+        v = v * 10 + (uint64_t)(*ptr++ - '0');
+    *value = v;
+    *pptr = ptr;
+    return 1;
+}
+
+static inline char *next_line(char *ptr)
+{
+    ptr = strchr(ptr, '\n');
+    return ptr ? ptr + 1 : NULL;
+}
+
+void sched_init(sched_t *sched)
+{
+    (void)memset(sched, 0, sizeof(*sched));
+    pfile_init(&sched->stat_file);
+    pfile_init(&sched->softirq.file);
+    pfile_init(&sched->irq.file);
+}
+
+int sched_config(sched_t *sched, const char *name, const char *value)
+{
+    if (EQU(name, "sched_stats"))
+    {
+        sched->schedstat = atoi(value);
+    }
+    else if (EQU(name, "softirq_stats"))
+    {
+        sched->softirqs = atoi(value);
+    }
+    else if (EQU(name, "irq_top"))
+    {
+        sched->irq_top = atoi(value);
+        if (sched->irq_top < 0)
+            sched->irq_top = 0;
+        if (sched->irq_top > SCHED_MAX_TOP)
+            sched->irq_top = SCHED_MAX_TOP;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static int schedstat_open(sched_t *sched, const char *path)
+{
+    char *ptr;
+    int n = 0;
+    if (pfile_open(&sched->stat_file, path) == -1 || pfile_read(&sched->stat_file, 0) <= 0)
+        return -1;
+    for (ptr = sched->stat_file.data; ptr != NULL; ptr = next_line(ptr))
+    {
+        if (strncmp(ptr, "cpu", 3) == 0)
+            n++;
+    }
+    if (n == 0)
+        return -1;
+    sched->n_cpus = n;
+    sched->last_delay = (uint64_t *)calloc(n, sizeof(uint64_t));
+    sched->last_slices = (uint64_t *)calloc(n, sizeof(uint64_t));
+    sched->wait = (float *)calloc(n, sizeof(float));
+    sched->slices = (float *)calloc(n, sizeof(float));
+    sched->avg_wait = (float *)calloc(n, sizeof(float));
+    if (!sched->last_delay || !sched->last_slices || !sched->wait || !sched->slices || !sched->avg_wait)
+        return -1;
+    return 0;
+}
+
+int sched_open(sched_t *sched, const char *root_dir)
+{
+    char path[MAX_BUF * 2];
+    if (sched->schedstat)
+    {
+        (void)snprintf(path, sizeof(path), "%s/proc/schedstat", root_dir);
+        if (schedstat_open(sched, path) == -1)
+        {
+            // needs CONFIG_SCHEDSTATS
+            M_ERROR(MODULE_NAME, "Unable to use %s, run-queue statistics disabled", path);
+            sched->schedstat = 0;
+        }
+    }
+    if (sched->softirqs)
+    {
+        (void)snprintf(path, sizeof(path), "%s/proc/softirqs", root_dir);
+        if (pfile_open(&sched->softirq.file, path) == -1)
+            sched->softirqs = 0;
+    }
+    if (sched->irq_top > 0)
+    {
+        (void)snprintf(path, sizeof(path), "%s/proc/interrupts", root_dir);
+        if (pfile_open(&sched->irq.file, path) == -1)
+            sched->irq_top = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &sched->last_time);
+    return (sched->schedstat || sched->softirqs || sched->irq_top) ? 0 : -1;
+}
+
+static int schedstat_read(sched_t *sched)
+{
+    char *ptr;
+    uint64_t fields[SCHEDSTAT_FIELDS], delay, slices;
+    int cpu, n;
+    if (pfile_read(&sched->stat_file, 0) <= 0)
+        return -1;
+    for (ptr = sched->stat_file.data; ptr != NULL; ptr = next_line(ptr))
+    {
+        if (ptr[0] != 'c' || ptr[1] != 'p' || ptr[2] != 'u')
+            continue;
+        ptr += 3;
+        cpu = 0;
+        while (*ptr >= '0' && *ptr <= '9')
+            cpu = cpu * 10 + (*ptr++ - '0');
+        if (cpu >= sched->n_cpus)
+            continue;
+        for (n = 0; n < SCHEDSTAT_FIELDS && parse_u64(&ptr, &fields[n]); n++)
+            ;
+        if (n < SCHEDSTAT_FIELDS)
+            continue;
+        delay = fields[SCHEDSTAT_RUN_DELAY] - sched->last_delay[cpu];
+        slices = fields[SCHEDSTAT_PCOUNT] - sched->last_slices[cpu];
+        if (sched->elapsed > 0.0 && sched->last_slices[cpu] > 0)
+        {
+            // ms spent waiting on the run-queue per second, and per timeslice in us
+            sched->wait[cpu] = (float)(delay / 1.0e6 / sched->elapsed);
+            sched->slices[cpu] = (float)(slices / sched->elapsed);
+            sched->avg_wait[cpu] = slices > 0 ? (float)(delay / 1.0e3 / slices) : 0.0f;
+        }
+        sched->last_delay[cpu] = fields[SCHEDSTAT_RUN_DELAY];
+        sched->last_slices[cpu] = fields[SCHEDSTAT_PCOUNT];
+    }
+    return 0;
+}
+
+static int table_resize(sched_table_t *table, int n_cols, int cap_rows)
+{
+    sched_row_t *rows;
+    uint64_t *last;
+    rows = (sched_row_t *)realloc(table->rows, cap_rows * sizeof(sched_row_t));
+    if (!rows)
+        return -1;
+    table->rows = rows;
+    last = (uint64_t *)realloc(table->last, (size_t)cap_rows * n_cols * sizeof(uint64_t));
+    if (!last)
+        return -1;
+    table->last = last;
+    table->cap_rows = cap_rows;
+    return 0;
+}
+
+static inline void top_insert(sched_top_t *top, int k, int row, uint64_t delta)
+{
+    int i;
+    for (i = k - 1; i > 0 && top[i - 1].delta < delta; i--)
+        top[i] = top[i - 1];
+    top[i].row = row;
+    top[i].delta = delta;
+}
+
+/**
+ * One pass over the table: rows are matched by position and name,
+ * a row that appears or changes (e.g. a new MSI vector) is primed
+ * again. When k > 0, the top k per CPU rates are ranked into sched->top
+ */
+static int table_read(sched_t *sched, sched_table_t *table, int k)
+{
+    sched_top_t *top = NULL;
+    char *ptr, *name, *end;
+    int n_cols = 0, row = 0, fresh, c;
+    size_t len;
+    uint64_t value, prev, *last;
+    double sum;
+    sched_row_t *r;
+    if (pfile_read(&table->file, 0) <= 0)
+        return -1;
+    ptr = table->file.data;
+    // header: one CPUn column per online CPU
+    end = strchr(ptr, '\n');
+    if (end == NULL)
+        return -1;
+    for (name = ptr; (name = strstr(name, "CPU")) != NULL && name < end; name += 3)
+        n_cols++;
+    if (n_cols != table->n_cols || table->rows == NULL)
+    {
+        if (table->fixed)
+            return -1;
+        if (table_resize(table, n_cols, table->cap_rows > 0 ? table->cap_rows : 32) == -1)
+            return -1;
+        table->n_cols = n_cols;
+        table->n_rows = 0;
+        table->primed = 0;
+    }
+    if (k > 0)
+    {
+        if (n_cols != sched->n_top_cpus || sched->top == NULL)
+        {
+            top = (sched_top_t *)realloc(sched->top, (size_t)n_cols * k * sizeof(sched_top_t));
+            if (!top)
+                return -1;
+            sched->top = top;
+            sched->n_top_cpus = n_cols;
+        }
+        top = sched->top;
+        for (int i = 0; i < n_cols * k; i++)
+        {
+            top[i].row = -1;
+            top[i].delta = 0;
+        }
+    }
+    for (ptr = end + 1; *ptr != '\0'; row++)
+    {
+        name = skip_spaces(ptr);
+        end = strchr(name, ':');
+        if (end == NULL)
+            break;
+        len = (size_t)(end - name);
+        if (len >= sizeof(table->rows[0].name))
+            len = sizeof(table->rows[0].name) - 1;
+        if (row >= table->cap_rows && table->fixed)
+            break;
+        if (row >= table->cap_rows && table_resize(table, n_cols, table->cap_rows * 2) == -1)
+            return -1;
+        r = &table->rows[row];
+        last = &table->last[(size_t)row * n_cols];
+        fresh = !table->primed || row >= table->n_rows || strncmp(r->name, name, len) != 0 || r->name[len] != '\0';
+        if (fresh)
+        {
+            (void)memcpy(r->name, name, len);
+            r->name[len] = '\0';
+            r->dev[0] = '\0';
+        }
+        ptr = end + 1;
+        sum = 0.0;
+        // ERR, MIS... have a single column
+        for (c = 0; c < n_cols && parse_u64(&ptr, &value); c++)
+        {
+            prev = last[c];
+            last[c] = value;
+            if (fresh || value < prev)
+                continue;
+            sum += (double)(value - prev);
+            // most counters do not move, and the others rarely beat the current top
+            if (top != NULL && value - prev > top[c * k + k - 1].delta)
+                top_insert(&top[c * k], k, row, value - prev);
+        }
+        for (; fresh && c < n_cols; c++)
+            last[c] = 0;
+        end = strchr(ptr, '\n');
+        if (fresh)
+        {
+            // device name: last word of the description
+            char *dev = end ? end : ptr + strlen(ptr);
+            while (dev > ptr && (dev[-1] == ' ' || dev[-1] == '\t'))
+                dev--;
+            name = dev;
+            while (name > ptr && name[-1] != ' ' && name[-1] != '\t')
+                name--;
+            len = (size_t)(dev - name);
+            if (len >= sizeof(r->dev))
+                len = sizeof(r->dev) - 1;
+            (void)memcpy(r->dev, name, len);
+            r->dev[len] = '\0';
+        }
+        r->rate = fresh ? 0.0 : sum / sched->elapsed;
+        if (end == NULL)
+        {
+            row++;
+            break;
+        }
+        ptr = end + 1;
+    }
+    table->n_rows = row;
+    table->primed = 1;
+    return 0;
+}
+
+int sched_read(sched_t *sched)
+{
+    struct timespec now;
+    int ret = 0;
+    if (!sched->schedstat && !sched->softirqs && !sched->irq_top)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    sched->elapsed = (now.tv_sec - sched->last_time.tv_sec) + (now.tv_nsec - sched->last_time.tv_nsec) / 1.0e9;
+    sched->last_time = now;
+    if (sched->elapsed <= 0.0)
+        sched->elapsed = 1.0e-3;
+    if (sched->schedstat && schedstat_read(sched) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to read schedstat: %s", strerror(errno));
+        ret = -1;
+    }
+    if (sched->softirqs && table_read(sched, &sched->softirq, 0) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to read softirqs: %s", strerror(errno));
+        ret = -1;
+    }
+    if (sched->irq_top && table_read(sched, &sched->irq, sched->irq_top) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to read interrupts: %s", strerror(errno));
+        ret = -1;
+    }
+    return ret;
+}
+
+static void encode_floats(obuf_t *ob, const float *values, int n)
+{
+    obuf_putc(ob, '[');
+    for (int i = 0; i < n; i++)
+    {
+        if (i > 0)
+            obuf_putc(ob, ',');
+        obuf_fixed(ob, values[i], 3);
+    }
+    obuf_putc(ob, ']');
+}
+
+void sched_encode(sched_t *sched, obuf_t *ob)
+{
+    sched_top_t *top;
+    if (sched->schedstat)
+    {
+        OBUF_LIT(ob, ",\"sched\":{\"rq_wait_ms\":");
+        encode_floats(ob, sched->wait, sched->n_cpus);
+        OBUF_LIT(ob, ",\"timeslices\":");
+        encode_floats(ob, sched->slices, sched->n_cpus);
+        OBUF_LIT(ob, ",\"avg_wait_us\":");
+        encode_floats(ob, sched->avg_wait, sched->n_cpus);
+        obuf_putc(ob, '}');
+    }
+    if (sched->softirqs)
+    {
+        OBUF_LIT(ob, ",\"softirqs\":{");
+        for (int i = 0; i < sched->softirq.n_rows; i++)
+        {
+            if (i > 0)
+                obuf_putc(ob, ',');
+            obuf_putc(ob, '"');
+            obuf_puts(ob, sched->softirq.rows[i].name);
+            OBUF_LIT(ob, "\": ");
+            obuf_fixed(ob, sched->softirq.rows[i].rate, 3);
+        }
+        obuf_putc(ob, '}');
+    }
+    if (sched->irq_top && sched->top != NULL)
+    {
+        OBUF_LIT(ob, ",\"irqs\":[");
+        for (int cpu = 0; cpu < sched->n_top_cpus; cpu++)
+        {
+            if (cpu > 0)
+                obuf_putc(ob, ',');
+            obuf_putc(ob, '[');
+            top = &sched->top[cpu * sched->irq_top];
+            for (int i = 0; i < sched->irq_top && top[i].row >= 0; i++)
+            {
+                if (i > 0)
+                    obuf_putc(ob, ',');
+                OBUF_LIT(ob, "{\"irq\":\"");
+                obuf_puts(ob, sched->irq.rows[top[i].row].name);
+                OBUF_LIT(ob, "\",\"dev\":\"");
+                obuf_puts(ob, sched->irq.rows[top[i].row].dev);
+                OBUF_LIT(ob, "\",\"rate\": ");
+                obuf_fixed(ob, top[i].delta / sched->elapsed, 3);
+                obuf_putc(ob, '}');
+            }
+            obuf_putc(ob, ']');
+        }
+        obuf_putc(ob, ']');
+    }
+}
+
+static void table_close(sched_table_t *table)
+{
+    pfile_close(&table->file);
+    if (table->rows)
+        free(table->rows);
+    if (table->last)
+        free(table->last);
+    table->rows = NULL;
+    table->last = NULL;
+    table->n_rows = 0;
+    table->cap_rows = 0;
+}
+
+static int table_reserve(sched_table_t *table)
+{
+    int ret = 0;
+    if (table->file.fd < 0 || table->rows == NULL)
+        return 0;
+    if (table->n_rows * 2 > table->cap_rows)
+        ret = table_resize(table, table->n_cols, table->n_rows * 2);
+    table->fixed = 1;
+    return ret;
+}
+
+int sched_reserve(sched_t *sched)
+{
+    int ret = table_reserve(&sched->softirq);
+    if (table_reserve(&sched->irq) == -1)
+        ret = -1;
+    return ret;
+}
+
+void sched_close(sched_t *sched)
+{
+    pfile_close(&sched->stat_file);
+    if (sched->last_delay)
+        free(sched->last_delay);
+    if (sched->last_slices)
+        free(sched->last_slices);
+    if (sched->wait)
+        free(sched->wait);
+    if (sched->slices)
+        free(sched->slices);
+    if (sched->avg_wait)
+        free(sched->avg_wait);
+    if (sched->top)
+        free(sched->top);
+    table_close(&sched->softirq);
+    table_close(&sched->irq);
+    sched_init(sched);
+}
@@ -0,0 +1,76 @@
+#ifndef SCHEDSTAT_H
+#define SCHEDSTAT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "pfile.h"
+
+#define SCHED_MAX_TOP 8
+
+/*row of a per-CPU counter table (/proc/softirqs, /proc/interrupts)*/
+typedef struct
+{
+    char name[16];
+    char dev[24];
+    double rate;
+} sched_row_t;
+
+typedef struct
+{
+    int row;
+    /*counter increase over the interval, turned into a rate when encoded*/
+    uint64_t delta;
+} sched_top_t;
+
+/**
+ * "NAME: v0 v1 ... [description]" table with one column per CPU,
+ * the previous values are kept in a preallocated row major array
+ */
+typedef struct
+{
+    pfile_t file;
+    int n_cols;
+    int n_rows;
+    int cap_rows;
+    int primed;
+    /*the arrays never grow (real-time mode): rows past cap_rows are ignored*/
+    int fixed;
+    sched_row_t *rows;
+    uint64_t *last;
+} sched_table_t;
+
+typedef struct
+{
+    int schedstat;
+    int softirqs;
+    /*top n IRQ sources per CPU, 0 disables /proc/interrupts*/
+    int irq_top;
+    struct timespec last_time;
+    double elapsed;
+    /*per-CPU /proc/schedstat run-queue statistics*/
+    pfile_t stat_file;
+    int n_cpus;
+    uint64_t *last_delay;
+    uint64_t *last_slices;
+    float *wait;
+    float *slices;
+    float *avg_wait;
+    sched_table_t softirq;
+    sched_table_t irq;
+    sched_top_t *top;
+    int n_top_cpus;
+} sched_t;
+
+void sched_init(sched_t *sched);
+int sched_config(sched_t *sched, const char *name, const char *value);
+int sched_open(sched_t *sched, const char *root_dir);
+int sched_read(sched_t *sched);
+void sched_encode(sched_t *sched, obuf_t *ob);
+/*reserve room for twice the rows seen so far, then never grow the tables*/
+int sched_reserve(sched_t *sched);
+void sched_close(sched_t *sched);
+
+#endif
@@ -0,0 +1,463 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+#include "sink.h"
+
+#define SINK_ZBUF_SIZE 65536
+
+static long elapsed_ms(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+size_t sink_parse_size(const char *value)
+{
+    char *end = NULL;
+    size_t size = (size_t)strtoul(value, &end, 10);
+    switch (end ? *end : '\0')
+    {
+    case 'k':
+    case 'K':
+        return size << 10;
+    case 'm':
+    case 'M':
+        return size << 20;
+    case 'g':
+    case 'G':
+        return size << 30;
+    default:
+        return size;
+    }
+}
+
+void file_sink_init(file_sink_t *sink)
+{
+    (void)memset(sink, 0, sizeof(*sink));
+    sink->fd = -1;
+    sink->batch_records = 1;
+    sink->fsync_policy = SINK_FSYNC_NEVER;
+    sink->compress = SINK_COMPRESS_NONE;
+    sink->rotate_keep = 1;
+}
+
+int file_sink_config(file_sink_t *sink, const char *name, const char *value)
+{
+    if (EQU(name, "file_batch_records"))
+    {
+        sink->batch_records = atoi(value);
+        if (sink->batch_records < 1)
+            sink->batch_records = 1;
+    }
+    else if (EQU(name, "file_batch_ms"))
+    {
+        sink->batch_ms = atoi(value);
+    }
+    else if (EQU(name, "file_rotate_size"))
+    {
+        sink->rotate_size = sink_parse_size(value);
+    }
+    else if (EQU(name, "file_rotate_interval"))
+    {
+        sink->rotate_interval = atoi(value);
+    }
+    else if (EQU(name, "file_rotate_keep"))
+    {
+        sink->rotate_keep = atoi(value);
+        if (sink->rotate_keep < 1)
+        {
+            // discarding the segment would delete the live log at every rotation
+            M_ERROR(MODULE_NAME, "file_rotate_keep must be at least 1, keep the last segment");
+            sink->rotate_keep = 1;
+        }
+    }
+    else if (EQU(name, "file_fsync"))
+    {
+        if (EQU(value, "batch"))
+            sink->fsync_policy = SINK_FSYNC_BATCH;
+        else if (EQU(value, "rotate"))
+            sink->fsync_policy = SINK_FSYNC_ROTATE;
+        else
+            sink->fsync_policy = SINK_FSYNC_NEVER;
+    }
+    else if (EQU(name, "file_compress"))
+    {
+        sink->compress = SINK_COMPRESS_NONE;
+        if (EQU(value, "gzip"))
+        {
+#ifdef HAVE_LIBZ
+            sink->compress = SINK_COMPRESS_GZIP;
+#else
+            M_ERROR(MODULE_NAME, "gzip compression is not supported by this build");
+#endif
+        }
+        else if (EQU(value, "zstd"))
+        {
+#ifdef HAVE_LIBZSTD
+            sink->compress = SINK_COMPRESS_ZSTD;
+#else
+            M_ERROR(MODULE_NAME, "zstd compression is not supported by this build");
+#endif
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static int z_begin(file_sink_t *sink)
+{
+    if (!sink->zbuf)
+    {
+        sink->zbuf = (char *)malloc(SINK_ZBUF_SIZE);
+        if (!sink->zbuf)
+            return -1;
+        sink->zbuf_cap = SINK_ZBUF_SIZE;
+    }
+    if (sink->zctx)
+    {
+        // a new segment restarts the stream on the same context, without allocation
+        switch (sink->compress)
+        {
+#ifdef HAVE_LIBZ
+        case SINK_COMPRESS_GZIP:
+            if (deflateReset((z_stream *)sink->zctx) != Z_OK)
+                return -1;
+            break;
+#endif
+#ifdef HAVE_LIBZSTD
+        case SINK_COMPRESS_ZSTD:
+            if (ZSTD_isError(ZSTD_CCtx_reset((ZSTD_CCtx *)sink->zctx, ZSTD_reset_session_only)))
+                return -1;
+            break;
+#endif
+        default:
+            break;
+        }
+        sink->zactive = 1;
+        return 0;
+    }
+    switch (sink->compress)
+    {
+#ifdef HAVE_LIBZ
+    case SINK_COMPRESS_GZIP:
+    {
+        z_stream *zs = (z_stream *)calloc(1, sizeof(z_stream));
+        if (!zs)
+            return -1;
+        /*windowBits + 16: gzip framing, so segments can be read with zcat*/
+        if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            free(zs);
+            return -1;
+        }
+        sink->zctx = zs;
+        break;
+    }
+#endif
+#ifdef HAVE_LIBZSTD
+    case SINK_COMPRESS_ZSTD:
+        sink->zctx = ZSTD_createCCtx();
+        if (!sink->zctx)
+            return -1;
+        break;
+#endif
+    default:
+        break;
+    }
+    sink->zactive = sink->zctx != NULL;
+    return 0;
+}
+
+static void z_end(file_sink_t *sink)
+{
+    if (!sink->zctx)
+        return;
+    switch (sink->compress)
+    {
+#ifdef HAVE_LIBZ
+    case SINK_COMPRESS_GZIP:
+        (void)deflateEnd((z_stream *)sink->zctx);
+        free(sink->zctx);
+        break;
+#endif
+#ifdef HAVE_LIBZSTD
+    case SINK_COMPRESS_ZSTD:
+        (void)ZSTD_freeCCtx((ZSTD_CCtx *)sink->zctx);
+        break;
+#endif
+    default:
+        break;
+    }
+    sink->zctx = NULL;
+    sink->zactive = 0;
+}
+
+/**
+ * Feed data to the segment compressor and write out everything it produces.
+ * Each call ends with a sync flush (or the end of the stream when final is set)
+ * so the segment stays decodable up to the last written batch.
+ * Return the number of compressed bytes written, or -1 on error
+ */
+static int z_write(file_sink_t *sink, const char *data, size_t len, int final)
+{
+    size_t have;
+    int written = 0;
+#if !defined(HAVE_LIBZ) && !defined(HAVE_LIBZSTD)
+    (void)data;
+    (void)len;
+    (void)final;
+    (void)have;
+#endif
+    switch (sink->compress)
+    {
+#ifdef HAVE_LIBZ
+    case SINK_COMPRESS_GZIP:
+    {
+        z_stream *zs = (z_stream *)sink->zctx;
+        zs->next_in = (Bytef *)data;
+        zs->avail_in = (uInt)len;
+        do
+        {
+            zs->next_out = (Bytef *)sink->zbuf;
+            zs->avail_out = (uInt)sink->zbuf_cap;
+            if (deflate(zs, final ? Z_FINISH : Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+            {
+                M_ERROR(MODULE_NAME, "Unable to compress data for %s", sink->path);
+                return -1;
+            }
+            have = sink->zbuf_cap - zs->avail_out;
+            if (have > 0 && guard_write(sink->fd, sink->zbuf, have) != (int)have)
+                return -1;
+            written += (int)have;
+        } while (zs->avail_out == 0);
+        break;
+    }
+#endif
+#ifdef HAVE_LIBZSTD
+    case SINK_COMPRESS_ZSTD:
+    {
+        size_t remaining;
+        ZSTD_inBuffer in = {data, len, 0};
+        do
+        {
+            ZSTD_outBuffer out = {sink->zbuf, sink->zbuf_cap, 0};
+            remaining = ZSTD_compressStream2((ZSTD_CCtx *)sink->zctx, &out, &in, final ? ZSTD_e_end : ZSTD_e_flush);
+            if (ZSTD_isError(remaining))
+            {
+                M_ERROR(MODULE_NAME, "Unable to compress data for %s: %s", sink->path, ZSTD_getErrorName(remaining));
+                return -1;
+            }
+            have = out.pos;
+            if (have > 0 && guard_write(sink->fd, sink->zbuf, have) != (int)have)
+                return -1;
+            written += (int)have;
+        } while (remaining != 0);
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+    return written;
+}
+
+static int seg_open(file_sink_t *sink)
+{
+    struct stat st;
+    sink->fd = open(sink->path, O_CREAT | O_WRONLY | O_APPEND | O_NONBLOCK | O_CLOEXEC, 0644);
+    if (sink->fd < 0)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open output file %s: %s", sink->path, strerror(errno));
+        return -1;
+    }
+    sink->regular = (fstat(sink->fd, &st) == 0 && S_ISREG(st.st_mode));
+    sink->seg_size = sink->regular ? (size_t)st.st_size : 0;
+    clock_gettime(CLOCK_MONOTONIC, &sink->seg_start);
+    if (sink->regular && sink->compress != SINK_COMPRESS_NONE && z_begin(sink) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to init compressor for %s", sink->path);
+        (void)close(sink->fd);
+        sink->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void seg_close(file_sink_t *sink, int finish)
+{
+    if (sink->fd < 0)
+        return;
+    if (finish && sink->zactive)
+    {
+        (void)z_write(sink, NULL, 0, 1);
+    }
+    sink->zactive = 0;
+    if (finish && sink->fsync_policy != SINK_FSYNC_NEVER)
+    {
+        (void)fsync(sink->fd);
+    }
+    (void)close(sink->fd);
+    sink->fd = -1;
+}
+
+static const char *seg_suffix(file_sink_t *sink)
+{
+    switch (sink->compress)
+    {
+    case SINK_COMPRESS_GZIP:
+        return ".gz";
+    case SINK_COMPRESS_ZSTD:
+        return ".zst";
+    default:
+        return "";
+    }
+}
+
+static void rotate(file_sink_t *sink)
+{
+    char from[MAX_BUF + 16];
+    char to[MAX_BUF + 16];
+    const char *suffix = seg_suffix(sink);
+    seg_close(sink, 1);
+    for (int i = sink->rotate_keep; i > 1; i--)
+    {
+        (void)snprintf(from, sizeof(from), "%s.%d%s", sink->path, i - 1, suffix);
+        (void)snprintf(to, sizeof(to), "%s.%d%s", sink->path, i, suffix);
+        (void)rename(from, to);
+    }
+    (void)snprintf(to, sizeof(to), "%s.1%s", sink->path, suffix);
+    if (rename(sink->path, to) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to rotate %s: %s", sink->path, strerror(errno));
+    }
+    (void)seg_open(sink);
+}
+
+int file_sink_open(file_sink_t *sink, const char *path)
+{
+    (void)strncpy(sink->path, path, MAX_BUF - 1);
+    return seg_open(sink);
+}
+
+int file_sink_flush(file_sink_t *sink)
+{
+    int ret;
+    if (sink->n_pending == 0)
+    {
+        return 0;
+    }
+    if (sink->fd < 0 && seg_open(sink) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Drop %d record(s): output %s is not available", sink->n_pending, sink->path);
+        sink->n_pending = 0;
+        sink->batch_len = 0;
+        return -1;
+    }
+    if (sink->zactive)
+        ret = z_write(sink, sink->batch, sink->batch_len, 0);
+    else
+        ret = guard_write(sink->fd, sink->batch, sink->batch_len);
+    sink->n_pending = 0;
+    sink->batch_len = 0;
+    if (ret < 0)
+    {
+        // reader gone or disk error, reopen on the next batch
+        seg_close(sink, 0);
+        return -1;
+    }
+    if (sink->fsync_policy == SINK_FSYNC_BATCH)
+    {
+        (void)fdatasync(sink->fd);
+    }
+    sink->seg_size += (size_t)ret;
+    if (sink->regular &&
+        ((sink->rotate_size > 0 && sink->seg_size >= sink->rotate_size) ||
+         (sink->rotate_interval > 0 && elapsed_ms(&sink->seg_start) >= sink->rotate_interval * 1000L)))
+    {
+        rotate(sink);
+    }
+    return ret;
+}
+
+/*make sure the batch buffer can hold size bytes without growing*/
+int file_sink_reserve(file_sink_t *sink, size_t size)
+{
+    if (size > sink->batch_cap)
+    {
+        if (sink->fixed)
+            return -1;
+        size_t cap = sink->batch_cap ? sink->batch_cap : 1024;
+        while (cap < size)
+            cap <<= 1;
+        char *ptr = (char *)realloc(sink->batch, cap);
+        if (!ptr)
+        {
+            M_ERROR(MODULE_NAME, "Unable to allocate batch buffer: %s", strerror(errno));
+            return -1;
+        }
+        sink->batch = ptr;
+        sink->batch_cap = cap;
+    }
+    return 0;
+}
+
+int file_sink_freeze(file_sink_t *sink, size_t size)
+{
+    int ret = file_sink_reserve(sink, size);
+    sink->fixed = 1;
+    return ret;
+}
+
+int file_sink_write(file_sink_t *sink, const char *data, size_t len)
+{
+    // a fixed batch is written early rather than grown
+    if (sink->fixed && sink->batch_len + len > sink->batch_cap && sink->n_pending > 0)
+        (void)file_sink_flush(sink);
+    if (file_sink_reserve(sink, sink->batch_len + len) == -1)
+    {
+        return -1;
+    }
+    (void)memcpy(sink->batch + sink->batch_len, data, len);
+    sink->batch_len += len;
+    if (sink->n_pending == 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &sink->first_pending);
+    }
+    sink->n_pending++;
+    if (sink->n_pending >= sink->batch_records ||
+        (sink->batch_ms > 0 && elapsed_ms(&sink->first_pending) >= sink->batch_ms))
+    {
+        return file_sink_flush(sink) < 0 ? -1 : (int)len;
+    }
+    return (int)len;
+}
+
+void file_sink_close(file_sink_t *sink)
+{
+    (void)file_sink_flush(sink);
+    seg_close(sink, 1);
+    z_end(sink);
+    if (sink->batch)
+        free(sink->batch);
+    if (sink->zbuf)
+        free(sink->zbuf);
+    sink->batch = NULL;
+    sink->zbuf = NULL;
+    sink->batch_cap = 0;
+    sink->zbuf_cap = 0;
+}
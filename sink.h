@@ -0,0 +1,66 @@
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "sysmon.h"
+
+typedef enum
+{
+    SINK_FSYNC_NEVER = 0,
+    SINK_FSYNC_BATCH,
+    SINK_FSYNC_ROTATE
+} sink_fsync_t;
+
+typedef enum
+{
+    SINK_COMPRESS_NONE = 0,
+    SINK_COMPRESS_GZIP,
+    SINK_COMPRESS_ZSTD
+} sink_compress_t;
+
+typedef struct
+{
+    char path[MAX_BUF];
+    int fd;
+    /*regular file: rotation and compression are only applied on those*/
+    int regular;
+    /*flush after n records or after batch_ms since the first pending one*/
+    int batch_records;
+    int batch_ms;
+    int n_pending;
+    struct timespec first_pending;
+    char *batch;
+    size_t batch_len;
+    size_t batch_cap;
+    /*the batch buffer never grows (real-time mode), records that do not fit are dropped*/
+    int fixed;
+    /*rotation: 0 disables the corresponding trigger*/
+    size_t rotate_size;
+    int rotate_interval;
+    int rotate_keep;
+    size_t seg_size;
+    struct timespec seg_start;
+    sink_fsync_t fsync_policy;
+    sink_compress_t compress;
+    /*kept across the segments, zactive while a stream is open on the current one*/
+    void *zctx;
+    int zactive;
+    char *zbuf;
+    size_t zbuf_cap;
+} file_sink_t;
+
+void file_sink_init(file_sink_t *sink);
+int file_sink_config(file_sink_t *sink, const char *name, const char *value);
+int file_sink_open(file_sink_t *sink, const char *path);
+int file_sink_reserve(file_sink_t *sink, size_t size);
+/*reserve size bytes of batch buffer, then never grow it*/
+int file_sink_freeze(file_sink_t *sink, size_t size);
+int file_sink_write(file_sink_t *sink, const char *data, size_t len);
+int file_sink_flush(file_sink_t *sink);
+void file_sink_close(file_sink_t *sink);
+/*size with an optional K, M or G suffix*/
+size_t sink_parse_size(const char *value);
+
+#endif
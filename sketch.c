@@ -0,0 +1,114 @@
+#include <string.h>
+#include <math.h>
+
+#include "sysmon.h"
+#include "sketch.h"
+
+/*gamma = (1 + a) / (1 - a) with a relative accuracy a of 1%*/
+#define SKETCH_GAMMA (1.01 / 0.99)
+
+static double log_gamma = 0.0;
+
+static inline int sketch_index(double value)
+{
+    int idx = (int)ceil(log(value / SKETCH_MIN_VALUE) / log_gamma);
+    if (idx < 0)
+        idx = 0;
+    if (idx >= SKETCH_BUCKETS)
+        idx = SKETCH_BUCKETS - 1;
+    return idx;
+}
+
+void sketch_init(sketch_t *sk)
+{
+    if (log_gamma == 0.0)
+        log_gamma = log(SKETCH_GAMMA);
+    (void)memset(sk, 0, sizeof(*sk));
+    sketch_reset(sk);
+}
+
+void sketch_reset(sketch_t *sk)
+{
+    // only clear what was used, the sketch is reset every output period
+    if (sk->hi >= sk->lo)
+        (void)memset(&sk->counts[sk->lo], 0, (sk->hi - sk->lo + 1) * sizeof(sk->counts[0]));
+    sk->n = 0;
+    sk->zero = 0;
+    sk->min = NAN;
+    sk->max = NAN;
+    sk->lo = SKETCH_BUCKETS;
+    sk->hi = -1;
+}
+
+void sketch_add(sketch_t *sk, double value)
+{
+    int idx;
+    if (isnan(value))
+        return;
+    if (sk->n == 0 || value < sk->min)
+        sk->min = value;
+    if (sk->n == 0 || value > sk->max)
+        sk->max = value;
+    sk->n++;
+    if (value < SKETCH_MIN_VALUE)
+    {
+        sk->zero++;
+        return;
+    }
+    idx = sketch_index(value);
+    sk->counts[idx]++;
+    if (idx < sk->lo)
+        sk->lo = idx;
+    if (idx > sk->hi)
+        sk->hi = idx;
+}
+
+/*value at quantile q (0-1), NaN when the sketch is empty*/
+double sketch_quantile(const sketch_t *sk, double q)
+{
+    uint64_t rank, seen;
+    double value;
+    if (sk->n == 0)
+        return NAN;
+    rank = (uint64_t)(q * (sk->n - 1));
+    if (rank < sk->zero)
+        return sk->min < 0.0 ? sk->min : 0.0;
+    seen = sk->zero;
+    for (int i = sk->lo; i <= sk->hi; i++)
+    {
+        seen += sk->counts[i];
+        if (seen > rank)
+        {
+            // middle of the bucket (gamma^(i-1), gamma^i] in the relative sense
+            value = SKETCH_MIN_VALUE * 2.0 * exp(i * log_gamma) / (SKETCH_GAMMA + 1.0);
+            if (value < sk->min)
+                value = sk->min;
+            if (value > sk->max)
+                value = sk->max;
+            return value;
+        }
+    }
+    return sk->max;
+}
+
+/*{"min": ..,"max": ..,"p50": ..,"p95": ..,"p99": ..}*/
+void sketch_encode(const sketch_t *sk, obuf_t *ob, int decimals)
+{
+    static const double qs[] = {0.5, 0.95, 0.99};
+    static const char *names[] = {",\"p50\": ", ",\"p95\": ", ",\"p99\": "};
+    if (sk->n == 0)
+    {
+        OBUF_LIT(ob, "{\"min\": null,\"max\": null,\"p50\": null,\"p95\": null,\"p99\": null}");
+        return;
+    }
+    OBUF_LIT(ob, "{\"min\": ");
+    obuf_fixed(ob, sk->min, decimals);
+    OBUF_LIT(ob, ",\"max\": ");
+    obuf_fixed(ob, sk->max, decimals);
+    for (int i = 0; i < 3; i++)
+    {
+        obuf_puts(ob, names[i]);
+        obuf_fixed(ob, sketch_quantile(sk, qs[i]), decimals);
+    }
+    obuf_putc(ob, '}');
+}
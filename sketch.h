@@ -0,0 +1,34 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+
+#include "obuf.h"
+
+/**
+ * Fixed memory quantile sketch: logarithmic buckets with a 1% relative
+ * accuracy from SKETCH_MIN_VALUE up to ~1e13, smaller values
+ * (and negative ones) are counted as zero
+ */
+#define SKETCH_BUCKETS 2048
+#define SKETCH_MIN_VALUE 1e-3
+
+typedef struct
+{
+    uint64_t n;
+    uint64_t zero;
+    double min;
+    double max;
+    /*range of the buckets touched since the last reset*/
+    int lo;
+    int hi;
+    uint32_t counts[SKETCH_BUCKETS];
+} sketch_t;
+
+void sketch_init(sketch_t *sk);
+void sketch_reset(sketch_t *sk);
+void sketch_add(sketch_t *sk, double value);
+double sketch_quantile(const sketch_t *sk, double q);
+void sketch_encode(const sketch_t *sk, obuf_t *ob, int decimals);
+
+#endif
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+#include "sockstat.h"
+
+#define SOCKSTAT_BUF_SIZE 32768
+
+static const char *tcp_states[SOCKSTAT_N_STATES] = {
+    "unknown", "established", "syn_sent", "syn_recv", "fin_wait1", "fin_wait2",
+    "time_wait", "close", "close_wait", "last_ack", "listen", "closing"};
+
+static const char *snmp_gauges[] = {"RtoAlgorithm", "RtoMin", "RtoMax", "MaxConn", "CurrEstab", NULL};
+
+void sockstat_init(sockstat_t *ss)
+{
+    (void)memset(ss, 0, sizeof(*ss));
+    ss->fd = -1;
+    ss->retrans_segs = -1;
+    pfile_init(&ss->snmp_file);
+    sketch_init(&ss->rtt);
+}
+
+int sockstat_config(sockstat_t *ss, const char *name, const char *value)
+{
+    char tmp[MAX_BUF];
+    char *token, *saveptr;
+    if (EQU(name, "socket_stats"))
+    {
+        ss->enabled = atoi(value);
+    }
+    else if (EQU(name, "socket_ports"))
+    {
+        // local or remote port, e.g. 80,443
+        (void)snprintf(tmp, sizeof(tmp), "%s", value);
+        ss->n_ports = 0;
+        for (token = strtok_r(tmp, ", ", &saveptr); token != NULL && ss->n_ports < SOCKSTAT_MAX_PORTS;
+             token = strtok_r(NULL, ", ", &saveptr))
+        {
+            ss->ports[ss->n_ports++] = (uint16_t)atoi(token);
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int sockstat_open(sockstat_t *ss, const char *root_dir)
+{
+    char path[MAX_BUF * 2];
+    struct timeval timeout = {1, 0};
+    ss->fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (ss->fd == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open sock_diag netlink socket: %s", strerror(errno));
+        return -1;
+    }
+    // a stalled dump must not block the sampling loop
+    (void)setsockopt(ss->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ss->buf = (char *)malloc(SOCKSTAT_BUF_SIZE);
+    if (!ss->buf)
+    {
+        sockstat_close(ss);
+        return -1;
+    }
+    ss->buf_cap = SOCKSTAT_BUF_SIZE;
+    (void)snprintf(path, sizeof(path), "%s/proc/net/snmp", root_dir);
+    if (pfile_open(&ss->snmp_file, path) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Protocol counters from %s are not available", path);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ss->last);
+    return 0;
+}
+
+static int port_match(sockstat_t *ss, const struct inet_diag_msg *msg)
+{
+    uint16_t sport, dport;
+    if (ss->n_ports == 0)
+        return 1;
+    sport = ntohs(msg->id.idiag_sport);
+    dport = ntohs(msg->id.idiag_dport);
+    for (int i = 0; i < ss->n_ports; i++)
+    {
+        if (ss->ports[i] == sport || ss->ports[i] == dport)
+            return 1;
+    }
+    return 0;
+}
+
+static void account(sockstat_t *ss, int protocol, struct nlmsghdr *nlh)
+{
+    struct inet_diag_msg *msg = (struct inet_diag_msg *)NLMSG_DATA(nlh);
+    struct rtattr *rta;
+    struct tcp_info info;
+    int len;
+    if (!port_match(ss, msg))
+        return;
+    if (protocol == IPPROTO_UDP)
+    {
+        ss->udp++;
+        return;
+    }
+    if (msg->idiag_state < SOCKSTAT_N_STATES)
+        ss->tcp_states[msg->idiag_state]++;
+    len = (int)(nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*msg)));
+    for (rta = (struct rtattr *)(msg + 1); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        if (rta->rta_type != INET_DIAG_INFO)
+            continue;
+        // older kernels send a shorter tcp_info
+        (void)memset(&info, 0, sizeof(info));
+        (void)memcpy(&info, RTA_DATA(rta), RTA_PAYLOAD(rta) < sizeof(info) ? RTA_PAYLOAD(rta) : sizeof(info));
+        ss->live_retrans += info.tcpi_total_retrans;
+        if (msg->idiag_state == TCP_ESTABLISHED && info.tcpi_rtt > 0)
+            sketch_add(&ss->rtt, info.tcpi_rtt);
+    }
+}
+
+/*dump the sockets of a family/protocol, streaming the replies through the reused buffer*/
+static int dump(sockstat_t *ss, int family, int protocol)
+{
+    struct
+    {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+    } request;
+    struct sockaddr_nl addr;
+    struct nlmsghdr *nlh;
+    ssize_t len;
+    (void)memset(&request, 0, sizeof(request));
+    request.nlh.nlmsg_len = sizeof(request);
+    request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.nlh.nlmsg_seq = ++ss->seq;
+    request.req.sdiag_family = (uint8_t)family;
+    request.req.sdiag_protocol = (uint8_t)protocol;
+    request.req.idiag_states = 0xffffffff;
+    if (protocol == IPPROTO_TCP)
+        request.req.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (sendto(ss->fd, &request, sizeof(request), 0, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+        return -1;
+    while (1)
+    {
+        len = recv(ss->fd, ss->buf, ss->buf_cap, 0);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        for (nlh = (struct nlmsghdr *)ss->buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+        {
+            if (nlh->nlmsg_seq != ss->seq)
+                continue;
+            if (nlh->nlmsg_type == NLMSG_DONE)
+                return 0;
+            if (nlh->nlmsg_type == NLMSG_ERROR)
+            {
+                errno = -((struct nlmsgerr *)NLMSG_DATA(nlh))->error;
+                return -1;
+            }
+            account(ss, protocol, nlh);
+        }
+    }
+}
+
+static void snmp_names(sockstat_snmp_t *table, int *n, char *ptr)
+{
+    char *end;
+    size_t len;
+    *n = 0;
+    while (*n < SOCKSTAT_MAX_SNMP)
+    {
+        while (*ptr == ' ')
+            ptr++;
+        if (*ptr == '\n' || *ptr == '\0')
+            break;
+        end = ptr + strcspn(ptr, " \n");
+        len = (size_t)(end - ptr);
+        if (len >= sizeof(table[0].name))
+            len = sizeof(table[0].name) - 1;
+        (void)memcpy(table[*n].name, ptr, len);
+        table[*n].name[len] = '\0';
+        table[*n].gauge = 0;
+        for (int i = 0; snmp_gauges[i] != NULL; i++)
+        {
+            if (strcmp(table[*n].name, snmp_gauges[i]) == 0)
+                table[*n].gauge = 1;
+        }
+        (*n)++;
+        ptr = end;
+    }
+}
+
+/*primed: the table was read before, the counters have a previous value*/
+static void snmp_values(sockstat_snmp_t *table, int n, char *ptr, double elapsed, int primed)
+{
+    char *end;
+    long long value;
+    for (int i = 0; i < n; i++)
+    {
+        value = strtoll(ptr, &end, 10);
+        if (end == ptr)
+            break;
+        ptr = end;
+        if (table[i].gauge)
+        {
+            table[i].value = (double)value;
+        }
+        else
+        {
+            table[i].delta = primed && (uint64_t)value >= table[i].last ? (uint64_t)value - table[i].last : 0;
+            table[i].value = table[i].delta / elapsed;
+        }
+        table[i].last = (uint64_t)value;
+    }
+}
+
+/*"Tcp: names" line followed by "Tcp: values"*/
+static int read_snmp(sockstat_t *ss, double elapsed)
+{
+    char *ptr, *values;
+    int udp, *n, primed;
+    if (ss->snmp_file.fd < 0)
+        return 0;
+    if (pfile_read(&ss->snmp_file, 0) <= 0)
+        return -1;
+    for (ptr = ss->snmp_file.data; ptr != NULL && *ptr != '\0';)
+    {
+        udp = strncmp(ptr, "Udp: ", 5) == 0;
+        if (!udp && strncmp(ptr, "Tcp: ", 5) != 0)
+        {
+            ptr = strchr(ptr, '\n');
+            ptr = ptr ? ptr + 1 : NULL;
+            continue;
+        }
+        values = strchr(ptr, '\n');
+        if (values == NULL)
+            break;
+        values++;
+        n = udp ? &ss->n_udp : &ss->n_tcp;
+        // the names are parsed once, by the first read that finds them
+        primed = *n > 0;
+        if (!primed)
+        {
+            snmp_names(udp ? ss->udp_snmp : ss->tcp_snmp, n, ptr + 5);
+            for (int i = 0; !udp && i < ss->n_tcp; i++)
+            {
+                if (strcmp(ss->tcp_snmp[i].name, "RetransSegs") == 0)
+                    ss->retrans_segs = i;
+            }
+        }
+        if (strncmp(values, ptr, 5) == 0)
+            snmp_values(udp ? ss->udp_snmp : ss->tcp_snmp, *n, values + 5, elapsed, primed);
+        ptr = strchr(values, '\n');
+        ptr = ptr ? ptr + 1 : NULL;
+    }
+    return 0;
+}
+
+int sockstat_read(sockstat_t *ss)
+{
+    static const int families[2] = {AF_INET, AF_INET6};
+    static const int protocols[2] = {IPPROTO_TCP, IPPROTO_UDP};
+    struct timespec now;
+    double elapsed;
+    int ret = 0;
+    if (ss->fd < 0)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - ss->last.tv_sec) + (now.tv_nsec - ss->last.tv_nsec) / 1.0e9;
+    ss->last = now;
+    if (elapsed <= 0.0)
+        elapsed = 1.0e-3;
+    (void)memset(ss->tcp_states, 0, sizeof(ss->tcp_states));
+    ss->udp = 0;
+    ss->live_retrans = 0;
+    sketch_reset(&ss->rtt);
+    // every dump runs, a failed one only leaves its own counters short
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            if (dump(ss, families[i], protocols[j]) == -1)
+            {
+                M_ERROR(MODULE_NAME, "Unable to dump %s %s sockets: %s", families[i] == AF_INET ? "IPv4" : "IPv6",
+                        protocols[j] == IPPROTO_TCP ? "TCP" : "UDP", strerror(errno));
+                ret = -1;
+            }
+        }
+    }
+    if (read_snmp(ss, elapsed) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to read protocol counters: %s", strerror(errno));
+        ret = -1;
+    }
+    return ret;
+}
+
+static void encode_snmp(obuf_t *ob, const sockstat_snmp_t *table, int n)
+{
+    obuf_putc(ob, '{');
+    for (int i = 0; i < n; i++)
+    {
+        if (i > 0)
+            obuf_putc(ob, ',');
+        obuf_putc(ob, '"');
+        obuf_puts(ob, table[i].name);
+        OBUF_LIT(ob, "\": ");
+        obuf_fixed(ob, table[i].value, table[i].gauge ? 0 : 3);
+    }
+    obuf_putc(ob, '}');
+}
+
+void sockstat_encode(sockstat_t *ss, obuf_t *ob)
+{
+    if (ss->fd < 0)
+        return;
+    OBUF_LIT(ob, ",\"sockets\":{\"tcp\":{");
+    for (int i = 1; i < SOCKSTAT_N_STATES; i++)
+    {
+        if (i > 1)
+            obuf_putc(ob, ',');
+        obuf_putc(ob, '"');
+        obuf_puts(ob, tcp_states[i]);
+        OBUF_LIT(ob, "\": ");
+        obuf_u64(ob, ss->tcp_states[i]);
+    }
+    OBUF_LIT(ob, "},\"udp\": ");
+    obuf_u64(ob, ss->udp);
+    if (ss->snmp_file.fd >= 0 && ss->retrans_segs >= 0)
+    {
+        OBUF_LIT(ob, ",\"retrans\": ");
+        obuf_u64(ob, ss->tcp_snmp[ss->retrans_segs].delta);
+    }
+    OBUF_LIT(ob, ",\"live_retrans\": ");
+    obuf_u64(ob, ss->live_retrans);
+    OBUF_LIT(ob, ",\"rtt_us\":");
+    sketch_encode(&ss->rtt, ob, 0);
+    if (ss->snmp_file.fd >= 0)
+    {
+        OBUF_LIT(ob, ",\"snmp\":{\"tcp\":");
+        encode_snmp(ob, ss->tcp_snmp, ss->n_tcp);
+        OBUF_LIT(ob, ",\"udp\":");
+        encode_snmp(ob, ss->udp_snmp, ss->n_udp);
+        obuf_putc(ob, '}');
+    }
+    obuf_putc(ob, '}');
+}
+
+void sockstat_close(sockstat_t *ss)
+{
+    if (ss->fd >= 0)
+        (void)close(ss->fd);
+    ss->fd = -1;
+    if (ss->buf)
+        free(ss->buf);
+    ss->buf = NULL;
+    pfile_close(&ss->snmp_file);
+}
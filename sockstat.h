@@ -0,0 +1,60 @@
+#ifndef SOCKSTAT_H
+#define SOCKSTAT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "pfile.h"
+#include "sketch.h"
+
+#define SOCKSTAT_MAX_PORTS 16
+/*TCP_ESTABLISHED (1) ... TCP_CLOSING (11)*/
+#define SOCKSTAT_N_STATES 12
+#define SOCKSTAT_MAX_SNMP 32
+
+typedef struct
+{
+    char name[32];
+    uint64_t last;
+    /*counters: increase since the previous sample*/
+    uint64_t delta;
+    double value;
+    /*gauges (CurrEstab, RtoMin...) are reported as is, the other counters as rates*/
+    int gauge;
+} sockstat_snmp_t;
+
+typedef struct
+{
+    int enabled;
+    int n_ports;
+    uint16_t ports[SOCKSTAT_MAX_PORTS];
+    int fd;
+    uint32_t seq;
+    /*dump receive buffer, reused for every message*/
+    char *buf;
+    size_t buf_cap;
+    uint64_t tcp_states[SOCKSTAT_N_STATES];
+    uint64_t udp;
+    /*retransmissions over the lifetime of the sockets open now*/
+    uint64_t live_retrans;
+    sketch_t rtt;
+    pfile_t snmp_file;
+    int n_tcp;
+    int n_udp;
+    sockstat_snmp_t tcp_snmp[SOCKSTAT_MAX_SNMP];
+    sockstat_snmp_t udp_snmp[SOCKSTAT_MAX_SNMP];
+    /*RetransSegs in tcp_snmp, -1 if missing*/
+    int retrans_segs;
+    struct timespec last;
+} sockstat_t;
+
+void sockstat_init(sockstat_t *ss);
+int sockstat_config(sockstat_t *ss, const char *name, const char *value);
+int sockstat_open(sockstat_t *ss, const char *root_dir);
+int sockstat_read(sockstat_t *ss);
+void sockstat_encode(sockstat_t *ss, obuf_t *ob);
+void sockstat_close(sockstat_t *ss);
+
+#endif
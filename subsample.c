@@ -0,0 +1,234 @@
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+
+#include "subsample.h"
+
+void subsample_init(subsample_t *ss)
+{
+    ss->period_ms = 0;
+    ss->tfd = -1;
+    pfile_init(&ss->stat);
+    ss->n_net = 0;
+    for (int i = 0; i < SUBSAMPLE_MAX_NET; i++)
+    {
+        pfile_init(&ss->rx[i]);
+        pfile_init(&ss->tx[i]);
+    }
+    ss->primed = 0;
+    sketch_init(&ss->cpu);
+    sketch_init(&ss->rx_rate);
+    sketch_init(&ss->tx_rate);
+}
+
+int subsample_config(subsample_t *ss, const char *name, const char *value)
+{
+    if (EQU(name, "subsample_period"))
+    {
+        ss->period_ms = atoi(value);
+        if (ss->period_ms < 0)
+            ss->period_ms = 0;
+        return 1;
+    }
+    return 0;
+}
+
+int subsample_open(subsample_t *ss, const char *stat_path)
+{
+    struct itimerspec spec;
+    if (pfile_open(&ss->stat, stat_path) == -1)
+        return -1;
+    ss->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (ss->tfd == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to create sub-sampling timer: %s", strerror(errno));
+        return -1;
+    }
+    spec.it_interval.tv_sec = ss->period_ms / 1000;
+    spec.it_interval.tv_nsec = (ss->period_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(ss->tfd, 0, &spec, NULL) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to set sub-sampling period: %s", strerror(errno));
+        (void)close(ss->tfd);
+        ss->tfd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int subsample_add_net(subsample_t *ss, const char *rx_path, const char *tx_path)
+{
+    if (ss->n_net >= SUBSAMPLE_MAX_NET)
+        return -1;
+    if (pfile_open(&ss->rx[ss->n_net], rx_path) == -1)
+        return -1;
+    if (pfile_open(&ss->tx[ss->n_net], tx_path) == -1)
+    {
+        pfile_close(&ss->rx[ss->n_net]);
+        return -1;
+    }
+    ss->n_net++;
+    return 0;
+}
+
+static int read_counter(pfile_t *pf, unsigned long *value)
+{
+    if (pfile_read(pf, 0) <= 0)
+        return -1;
+    *value = strtoul(pf->data, NULL, 10);
+    return 0;
+}
+
+/*delta of a counter, 0 when it went backwards*/
+static unsigned long delta(unsigned long value, unsigned long last)
+{
+    return value >= last ? value - last : 0;
+}
+
+static void subsample_take(subsample_t *ss)
+{
+    struct timespec now;
+    unsigned long cols[SUBSAMPLE_CPU_COLS] = {0};
+    unsigned long rx[SUBSAMPLE_MAX_NET], tx[SUBSAMPLE_MAX_NET];
+    unsigned long d, sum = 0, idle = 0, rx_sum = 0, tx_sum = 0;
+    char *ptr, *end;
+    double elapsed;
+    int net_ok = 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    // only the first (aggregated) cpu line is needed
+    if (pfile_read(&ss->stat, 1) <= 0 || strncmp(ss->stat.data, "cpu ", 4) != 0)
+        return;
+    ptr = ss->stat.data + 4;
+    for (int j = 0; j < SUBSAMPLE_CPU_COLS; j++)
+    {
+        cols[j] = strtoul(ptr, &end, 10);
+        if (end == ptr)
+            break;
+        ptr = end;
+    }
+    for (int i = 0; i < ss->n_net; i++)
+    {
+        if (read_counter(&ss->rx[i], &rx[i]) == -1 || read_counter(&ss->tx[i], &tx[i]) == -1)
+        {
+            net_ok = 0;
+            rx[i] = ss->last_rx[i];
+            tx[i] = ss->last_tx[i];
+        }
+    }
+    if (ss->primed)
+    {
+        elapsed = (now.tv_sec - ss->last_time.tv_sec) + (now.tv_nsec - ss->last_time.tv_nsec) / 1.0e9;
+        // iowait may go backwards on NO_HZ kernels, a negative column delta counts as 0 as in read_cpu_info
+        for (int j = 0; j < SUBSAMPLE_CPU_COLS; j++)
+        {
+            d = delta(cols[j], ss->last_cols[j]);
+            sum += d;
+            if (j == 3)
+                idle = d;
+        }
+        // no jiffy elapsed since the last read: nothing to measure yet
+        if (sum > 0)
+            sketch_add(&ss->cpu, 100.0 - idle * 100.0 / sum);
+        // a counter going backwards (interface reset or re-created) gives no rate for this sample
+        for (int i = 0; net_ok && i < ss->n_net; i++)
+        {
+            if (rx[i] < ss->last_rx[i] || tx[i] < ss->last_tx[i])
+            {
+                net_ok = 0;
+                break;
+            }
+            rx_sum += rx[i] - ss->last_rx[i];
+            tx_sum += tx[i] - ss->last_tx[i];
+        }
+        if (net_ok && ss->n_net > 0 && elapsed > 0.0)
+        {
+            sketch_add(&ss->rx_rate, (double)rx_sum / elapsed);
+            sketch_add(&ss->tx_rate, (double)tx_sum / elapsed);
+        }
+    }
+    ss->primed = 1;
+    ss->last_time = now;
+    memcpy(ss->last_cols, cols, sizeof(cols));
+    memcpy(ss->last_rx, rx, ss->n_net * sizeof(rx[0]));
+    memcpy(ss->last_tx, tx, ss->n_net * sizeof(tx[0]));
+}
+
+/**
+ * Block until the output timer tfd is readable, taking the fast
+ * samples in between. Return 0, or -1 when poll fails
+ */
+int subsample_wait(subsample_t *ss, int tfd)
+{
+    struct pollfd fds[2];
+    uint64_t expirations;
+    fds[0].fd = tfd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ss->tfd;
+    fds[1].events = POLLIN;
+    while (1)
+    {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+                return 0;
+            M_ERROR(MODULE_NAME, "Unable to poll sub-sampling timer: %s", strerror(errno));
+            return -1;
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            // missed fast ticks are not replayed, the next sample covers the whole gap
+            if (read(ss->tfd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations))
+                subsample_take(ss);
+        }
+        if (fds[0].revents & POLLIN)
+            return 0;
+    }
+}
+
+void subsample_encode(subsample_t *ss, obuf_t *ob)
+{
+    OBUF_LIT(ob, ",\"subsample\":{\"period_ms\": ");
+    obuf_u64(ob, (uint64_t)ss->period_ms);
+    OBUF_LIT(ob, ",\"samples\": ");
+    obuf_u64(ob, ss->cpu.n);
+    OBUF_LIT(ob, ",\"cpu_usage\":");
+    sketch_encode(&ss->cpu, ob, 3);
+    if (ss->n_net > 0)
+    {
+        OBUF_LIT(ob, ",\"rx_rate\":");
+        sketch_encode(&ss->rx_rate, ob, 3);
+        OBUF_LIT(ob, ",\"tx_rate\":");
+        sketch_encode(&ss->tx_rate, ob, 3);
+    }
+    obuf_putc(ob, '}');
+}
+
+/*start a new output interval*/
+void subsample_reset(subsample_t *ss)
+{
+    sketch_reset(&ss->cpu);
+    sketch_reset(&ss->rx_rate);
+    sketch_reset(&ss->tx_rate);
+}
+
+void subsample_close(subsample_t *ss)
+{
+    if (ss->tfd >= 0)
+        (void)close(ss->tfd);
+    ss->tfd = -1;
+    pfile_close(&ss->stat);
+    for (int i = 0; i < ss->n_net; i++)
+    {
+        pfile_close(&ss->rx[i]);
+        pfile_close(&ss->tx[i]);
+    }
+    ss->n_net = 0;
+}
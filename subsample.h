@@ -0,0 +1,48 @@
+#ifndef SUBSAMPLE_H
+#define SUBSAMPLE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "pfile.h"
+#include "sketch.h"
+
+#define SUBSAMPLE_MAX_NET 64
+/*columns of the aggregated cpu line, as summed by the main collector*/
+#define SUBSAMPLE_CPU_COLS 10
+
+/**
+ * Fast internal sampling of the CPU usage and network rates between
+ * two output records, summarized by quantile sketches
+ */
+typedef struct
+{
+    int period_ms;
+    int tfd;
+    pfile_t stat;
+    int n_net;
+    pfile_t rx[SUBSAMPLE_MAX_NET];
+    pfile_t tx[SUBSAMPLE_MAX_NET];
+    /*previous raw counters*/
+    int primed;
+    struct timespec last_time;
+    unsigned long last_cols[SUBSAMPLE_CPU_COLS];
+    unsigned long last_rx[SUBSAMPLE_MAX_NET];
+    unsigned long last_tx[SUBSAMPLE_MAX_NET];
+    sketch_t cpu;
+    sketch_t rx_rate;
+    sketch_t tx_rate;
+} subsample_t;
+
+void subsample_init(subsample_t *ss);
+int subsample_config(subsample_t *ss, const char *name, const char *value);
+int subsample_open(subsample_t *ss, const char *stat_path);
+int subsample_add_net(subsample_t *ss, const char *rx_path, const char *tx_path);
+int subsample_wait(subsample_t *ss, int tfd);
+void subsample_encode(subsample_t *ss, obuf_t *ob);
+void subsample_reset(subsample_t *ss);
+void subsample_close(subsample_t *ss);
+
+#endif
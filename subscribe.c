@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "subscribe.h"
+
+void subscribe_init(subscribe_t *sub)
+{
+    (void)memset(sub, 0, sizeof(*sub));
+    sub->listen_fd = -1;
+    for (int i = SUBSCRIBE_MAX_CLIENTS - 1; i >= 0; i--)
+    {
+        sub->pool[i].next = sub->free_clients;
+        sub->free_clients = &sub->pool[i];
+    }
+}
+
+int subscribe_config(subscribe_t *sub, const char *name, const char *value)
+{
+    if (EQU(name, "subscribe_socket"))
+    {
+        (void)snprintf(sub->path, sizeof(sub->path), "%s", value);
+        return 1;
+    }
+    return 0;
+}
+
+int subscribe_open(subscribe_t *sub)
+{
+    struct sockaddr_un address;
+    if (strlen(sub->path) >= sizeof(address.sun_path))
+    {
+        M_ERROR(MODULE_NAME, "Subscription socket path is too long: %s", sub->path);
+        return -1;
+    }
+    (void)memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    (void)strcpy(address.sun_path, sub->path);
+    (void)unlink(address.sun_path);
+    // message oriented: one frame per send, a full socket buffer drops whole frames only
+    sub->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sub->listen_fd == -1 || bind(sub->listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+        listen(sub->listen_fd, SOMAXCONN) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to listen on %s: %s", sub->path, strerror(errno));
+        if (sub->listen_fd != -1)
+            (void)close(sub->listen_fd);
+        sub->listen_fd = -1;
+        return -1;
+    }
+    M_LOG(MODULE_NAME, "Subscriptions: listening on %s", sub->path);
+    return 0;
+}
+
+static void client_close(subscribe_t *sub, sub_client_t **link)
+{
+    sub_client_t *client = *link;
+    M_LOG(MODULE_NAME, "Subscriber pid:%d left, %llu frames sent, %llu dropped", client->pid,
+          (unsigned long long)client->sent, (unsigned long long)client->dropped);
+    *link = client->next;
+    (void)close(client->fd);
+    client->next = sub->free_clients;
+    sub->free_clients = client;
+    sub->n_clients--;
+}
+
+static void client_accept(subscribe_t *sub)
+{
+    struct ucred cred;
+    socklen_t cred_len;
+    sub_client_t *client;
+    int fd;
+    while ((fd = accept4(sub->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+    {
+        client = sub->free_clients;
+        if (!client)
+        {
+            M_ERROR(MODULE_NAME, "Subscriptions: %d clients already, connection refused", SUBSCRIBE_MAX_CLIENTS);
+            (void)close(fd);
+            continue;
+        }
+        sub->free_clients = client->next;
+        (void)memset(client, 0, sizeof(*client));
+        client->fd = fd;
+        cred_len = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0)
+            client->pid = (int)cred.pid;
+        client->next = sub->clients;
+        sub->clients = client;
+        sub->n_clients++;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        M_ERROR(MODULE_NAME, "Subscriptions: unable to accept: %s", strerror(errno));
+}
+
+/*apply the last pending request, 0 when the client hung up or sent garbage*/
+static int client_read(sub_client_t *client)
+{
+    sysmon_request_t req;
+    ssize_t len;
+    while ((len = recv(client->fd, &req, sizeof(req), MSG_DONTWAIT)) != -1)
+    {
+        if (len != (ssize_t)sizeof(req) || req.magic != SYSMON_MAGIC || req.version != SYSMON_VERSION)
+            return 0;
+        client->mask = req.mask == SYSMON_ALL_FIELDS ? ~0ull : req.mask;
+        client->decimation = req.decimation == 0 ? 1 : req.decimation;
+        client->tick = 0;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+void subscribe_poll(subscribe_t *sub)
+{
+    sub_client_t **link = &sub->clients;
+    if (sub->listen_fd == -1)
+        return;
+    client_accept(sub);
+    while (*link)
+    {
+        if (client_read(*link))
+            link = &(*link)->next;
+        else
+            client_close(sub, link);
+    }
+}
+
+void subscribe_publish(subscribe_t *sub, const double *values, int n_values, int64_t stamp_usec)
+{
+    sysmon_frame_t frame;
+    sub_client_t **link = &sub->clients;
+    sub_client_t *client;
+    char *payload = (char *)sub->frame + sizeof(frame);
+    uint64_t mask, all;
+    size_t len;
+    if (sub->listen_fd == -1)
+        return;
+    sub->seq++;
+    if (n_values > SYSMON_MAX_FIELDS)
+        n_values = SYSMON_MAX_FIELDS;
+    all = n_values == SYSMON_MAX_FIELDS ? ~0ull : SYSMON_FIELD_BIT(n_values) - 1;
+    while ((client = *link) != NULL)
+    {
+        if (client->decimation == 0 || client->tick != 0)
+        {
+            if (client->decimation != 0 && ++client->tick == client->decimation)
+                client->tick = 0;
+            link = &client->next;
+            continue;
+        }
+        if (client->decimation > 1)
+            client->tick = 1;
+        (void)memset(&frame, 0, sizeof(frame));
+        frame.magic = SYSMON_MAGIC;
+        frame.seq = sub->seq;
+        frame.stamp_usec = stamp_usec;
+        frame.mask = client->mask & all;
+        // only the selected values are copied, in bit order
+        for (mask = frame.mask; mask != 0; mask &= mask - 1, frame.n_values++)
+            (void)memcpy(payload + frame.n_values * sizeof(double), &values[__builtin_ctzll(mask)], sizeof(double));
+        (void)memcpy(sub->frame, &frame, sizeof(frame));
+        len = sizeof(frame) + frame.n_values * sizeof(double);
+        if (send(client->fd, sub->frame, len, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)len)
+        {
+            client->sent++;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // a slow client loses frames, the sampling loop never waits for it
+            client->dropped++;
+        }
+        else
+        {
+            client_close(sub, link);
+            continue;
+        }
+        link = &client->next;
+    }
+}
+
+void subscribe_close(subscribe_t *sub)
+{
+    while (sub->clients)
+        client_close(sub, &sub->clients);
+    if (sub->listen_fd != -1)
+    {
+        (void)close(sub->listen_fd);
+        (void)unlink(sub->path);
+    }
+    sub->listen_fd = -1;
+}
@@ -0,0 +1,46 @@
+#ifndef SUBSCRIBE_H
+#define SUBSCRIBE_H
+
+#include <stdint.h>
+
+#include "sysmon.h"
+#include "libsysmon.h"
+
+/*clients come from a fixed pool, no allocation once the daemon runs*/
+#define SUBSCRIBE_MAX_CLIENTS 32
+
+typedef struct sub_client
+{
+    int fd;
+    int pid;
+    /*0 until the first request: nothing is sent before the client subscribes*/
+    uint16_t decimation;
+    uint16_t tick;
+    uint64_t mask;
+    uint64_t sent;
+    uint64_t dropped;
+    struct sub_client *next;
+} sub_client_t;
+
+typedef struct
+{
+    char path[MAX_BUF];
+    int listen_fd;
+    int n_clients;
+    sub_client_t *clients;
+    sub_client_t *free_clients;
+    sub_client_t pool[SUBSCRIBE_MAX_CLIENTS];
+    uint64_t seq;
+    /*frame header plus the selected values, encoded per client*/
+    uint64_t frame[(sizeof(sysmon_frame_t) + SYSMON_MAX_FIELDS * sizeof(double)) / sizeof(uint64_t)];
+} subscribe_t;
+
+void subscribe_init(subscribe_t *sub);
+int subscribe_config(subscribe_t *sub, const char *name, const char *value);
+int subscribe_open(subscribe_t *sub);
+/*accept the new clients and apply their pending requests*/
+void subscribe_poll(subscribe_t *sub);
+void subscribe_publish(subscribe_t *sub, const double *values, int n_values, int64_t stamp_usec);
+void subscribe_close(subscribe_t *sub);
+
+#endif
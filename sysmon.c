@@ -14,63 +14,42 @@
 #include <sys/time.h>
 #include <sys/statvfs.h>
 #include <math.h>
-#include <sys/socket.h>
-#include <sys/un.h>
 
 #include "ini.h"
+#include "sysmon.h"
+#include "sink.h"
+#include "obuf.h"
+#include "metrics.h"
+#include "alert.h"
+#include "perf.h"
+#include "pfile.h"
+#include "aggregator.h"
+#include "rt.h"
+#include "adaptive.h"
+#include "subsample.h"
+#include "uring.h"
+#include "power.h"
+#include "schedstat.h"
+#include "numa.h"
+#include "sockstat.h"
+#include "vmstat.h"
+#include "subscribe.h"
+#include "history.h"
+#include "anomaly.h"
+#include "batsample.h"
+#include "output.h"
 #ifndef PREFIX
 #define PREFIX
 #endif
 #define DEFAULT_CONF_FILE (PREFIX "/etc/sysmond.conf")
-#define MODULE_NAME "sysmon"
-#define NET_INF_STAT_PT "/sys/class/net/%s/statistics/%s"
-
-#define LOG_INIT(m)                                              \
-    do                                                           \
-    {                                                            \
-        setlogmask(LOG_UPTO(LOG_NOTICE));                        \
-        openlog((m), LOG_CONS | LOG_PID | LOG_NDELAY, LOG_USER); \
-    } while (0)
-
-#define M_LOG(m, a, ...) syslog((LOG_NOTICE), m "_log@[%s: %d]: " a "\n", __FILE__, \
-                                __LINE__, ##__VA_ARGS__)
-
-#define M_ERROR(m, a, ...) syslog((LOG_ERR), m "_error@[%s: %d]: " a "\n", __FILE__, \
-                                  __LINE__, ##__VA_ARGS__)
-
-#define JSON_FMT "{"                            \
-                 "\"stamp_sec\": %lu,"          \
-                 "\"stamp_usec\": %lu,"         \
-                 "\"battery\": %.3f,"           \
-                 "\"battery_percent\": %.3f,"   \
-                 "\"battery_max_voltage\": %d," \
-                 "\"battery_min_voltage\": %d," \
-                 "\"cpu_temp\": %d,"            \
-                 "\"gpu_temp\": %d,"            \
-                 "\"cpu_usages\":[%s],"         \
-                 "\"mem_total\": %lu,"          \
-                 "\"mem_free\": %lu,"           \
-                 "\"mem_used\": %lu,"           \
-                 "\"mem_buff_cache\": %lu,"     \
-                 "\"mem_available\": %lu,"      \
-                 "\"mem_swap_total\": %lu,"     \
-                 "\"mem_swap_free\": %lu,"      \
-                 "\"disk_total\": %lu,"         \
-                 "\"disk_free\": %lu,"          \
-                 "\"net\":[%s]"                 \
-                 "}"
-
-#define JSON_NET_FMT "{"                  \
-                     "\"name\":\"%s\","   \
-                     "\"rx\": %lu,"       \
-                     "\"tx\": %lu,"       \
-                     "\"rx_rate\": %.3f," \
-                     "\"tx_rate\": %.3f"  \
-                     "},"
-
-#define MAX_BUF 256
-#define EQU(a, b) (strncmp(a, b, MAX_BUF) == 0)
-#define MAX_NETWORK_INF 8
+#define NET_INF_STAT_PT "%s/sys/class/net/%s/statistics/%s"
+#define CPU_FREQ_PT "%s/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq"
+/*user nice system idle iowait irq softirq steal guest guest_nice*/
+#define CPU_STAT_COLS 10
+
+#define MAX_NETWORK_INF 64
+/*alert and anomaly events, in real-time mode*/
+#define RT_EVENT_SIZE 4096
 
 typedef struct
 {
@@ -79,8 +58,10 @@ typedef struct
     uint16_t min_voltage;
     uint16_t cutoff_voltage;
     float ratio;
-    uint16_t read_voltage;
+    /*raw unit of battery_input, filtered when the sampler thread runs*/
+    float read_voltage;
     float percent;
+    pfile_t file;
 } sys_bat_t;
 
 typedef struct
@@ -89,6 +70,8 @@ typedef struct
     char gpu_temp_file[MAX_BUF];
     uint32_t cpu;
     uint32_t gpu;
+    pfile_t cpu_file;
+    pfile_t gpu_file;
 } sys_temp_t;
 
 typedef struct
@@ -98,20 +81,27 @@ typedef struct
     unsigned long rx;
     float rx_rate;
     float tx_rate;
+    pfile_t rx_file;
+    pfile_t tx_file;
 } sys_net_inf_t;
 
 typedef struct
 {
     uint8_t n_intf;
-    /*Monitor up to 8 interfaces*/
+    /*Monitor up to 64 interfaces*/
     sys_net_inf_t interfaces[MAX_NETWORK_INF];
+    /*rates use the measured interval, the sample period may change*/
+    struct timespec last_read;
 } sys_net_t;
 
 typedef struct
 {
-    unsigned long last_idle;
-    unsigned long last_sum;
     float percent;
+    /*per column share of the elapsed time, in %*/
+    unsigned long last[CPU_STAT_COLS];
+    float times[CPU_STAT_COLS];
+    int freq_fd;
+    uint32_t freq;
 } sys_cpu_t;
 
 typedef struct
@@ -136,13 +126,44 @@ typedef struct
 {
     char conf_file[MAX_BUF];
     char data_file_out[MAX_BUF];
+    /*prefix of the /proc and /sys paths, used to run on fixture trees*/
+    char root_dir[MAX_BUF];
+    char host_name[64];
+    int aggregator_mode;
+    aggregator_t agg;
     sys_bat_t bat_stat;
     sys_cpu_t *cpus;
     sys_mem_t mem;
     sys_temp_t temp;
     sys_net_t net;
     sys_disk_t disk;
+    /*file_* settings shared by the file outputs*/
+    file_sink_t fsink;
+    output_t out;
+    alert_t alert;
+    perf_t perf;
+    int perf_counters;
+    rt_t rt;
+    rt_jitter_t jitter;
+    adaptive_t adaptive;
+    subsample_t subsample;
+    uring_t uring;
+    power_t power;
+    sched_t sched;
+    numa_t numa;
+    sockstat_t sockstat;
+    vmstat_t vmstat;
+    subscribe_t subscribe;
+    history_t history;
+    anomaly_t anomaly;
+    batsample_t batsample;
+    batsample_value_t bat_value;
+    double metrics[METRIC_COUNT];
     int n_cpus;
+    pfile_t stat;
+    pfile_t meminfo;
+    int cpu_times;
+    int cpu_freq;
     struct itimerspec sample_period;
     int pwoff_cd;
     uint8_t power_off_percent;
@@ -170,22 +191,10 @@ static void help(const char *app)
 static void map(app_data_t *opt)
 {
     float volt = opt->bat_stat.read_voltage * opt->bat_stat.ratio;
-    if (volt < opt->bat_stat.min_voltage)
-    {
-        opt->bat_stat.percent = 0.0;
-        return;
-    }
-    float result = 101 - (101 / pow(1 + pow(1.33 * (volt - opt->bat_stat.min_voltage) /
-                                                (opt->bat_stat.max_voltage - opt->bat_stat.min_voltage),
-                                            4.5),
-                                    3));
-    if (result > 100.0)
-        result = 100.0;
-
-    opt->bat_stat.percent = result;
+    opt->bat_stat.percent = battery_map_percent(volt, opt->bat_stat.min_voltage, opt->bat_stat.max_voltage);
 }
 
-static int guard_write(int fd, void *buffer, size_t size)
+int guard_write(int fd, void *buffer, size_t size)
 {
     int n = 0;
     int write_len;
@@ -209,105 +218,100 @@ static int guard_write(int fd, void *buffer, size_t size)
     return n;
 }
 
-static int open_unix_socket(char *path)
+/*no reading: the record and the alert rules see the battery as unavailable, not its last value*/
+static void voltage_unavailable(app_data_t *opts)
 {
-    struct sockaddr_un address;
-    address.sun_family = AF_UNIX;
-    (void)memset(address.sun_path, 0, sizeof(address.sun_path));
-    (void)memcpy(address.sun_path, path, sizeof(address.sun_path));
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd == -1)
-    {
-        M_ERROR(MODULE_NAME, "Unable to create Unix domain socket: %s", strerror(errno));
-        return -1;
-    }
-    if (connect(fd, (struct sockaddr *)(&address), sizeof(address)) == -1)
-    {
-        M_ERROR(MODULE_NAME, "Unable to connect to socket '%s': %s", address.sun_path, strerror(errno));
-        return -1;
-    }
-    M_LOG(MODULE_NAME, "Socket %s is created successfully", path);
-    return fd;
-}
-
-static int read_line(int fd, char *buf, int size)
-{
-    int i = 0;
-    char c = '\0';
-    int n;
-    while ((i < size - 1) && (c != '\n'))
-    {
-        n = read(fd, &c, 1);
-        if (n > 0)
-        {
-            buf[i] = c;
-            i++;
-        }
-        else
-            c = '\n';
-    }
-    buf[i] = '\0';
-    return i;
+    opts->bat_stat.read_voltage = NAN;
+    opts->bat_stat.percent = NAN;
 }
 
 static int read_voltage(app_data_t *opts)
 {
-    int fd, ret;
     if (opts->bat_stat.bat_in[0] == '\0')
     {
         return 0;
     }
-    fd = open(opts->bat_stat.bat_in, O_RDONLY);
-    if (fd < 0)
+    if (opts->batsample.started)
+    {
+        // filtered by the sampler thread, nothing to read here, but its last reading may be too old
+        if (batsample_get(&opts->batsample, &opts->bat_value) == -1 ||
+            batsample_stale(&opts->batsample, &opts->bat_value))
+        {
+            voltage_unavailable(opts);
+            return -1;
+        }
+        opts->bat_stat.read_voltage = opts->bat_value.filtered;
+        map(opts);
+        return 0;
+    }
+    if (opts->bat_stat.file.fd < 0 && pfile_open(&opts->bat_stat.file, opts->bat_stat.bat_in) == -1)
     {
         M_ERROR(MODULE_NAME, "Unable to open input: %s", opts->bat_stat.bat_in);
+        voltage_unavailable(opts);
         return -1;
     }
-    (void)memset(buf, '\0', sizeof(buf));
-    ret = read(fd, buf, sizeof(buf));
-    if (ret > 0)
+    if (pfile_read(&opts->bat_stat.file, 0) <= 0)
     {
-        opts->bat_stat.read_voltage = atoi(buf);
-        map(opts);
+        voltage_unavailable(opts);
+        return -1;
     }
-    (void)close(fd);
+    opts->bat_stat.read_voltage = atoi(opts->bat_stat.file.data);
+    map(opts);
     return 0;
 }
 
 static int read_cpu_info(app_data_t *opts)
 {
-    int fd, ret, j, i = 0;
-    const char d[2] = " ";
-    char *token;
-    unsigned long sum = 0, idle = 0;
-    fd = open("/proc/stat", O_RDONLY);
-    if (fd < 0)
+    int j, i = 0;
+    char *ptr, *end;
+    char path[MAX_BUF * 2];
+    unsigned long sum, col, delta[CPU_STAT_COLS];
+    sys_cpu_t *cpu;
+    if (opts->stat.fd < 0)
     {
-        M_ERROR(MODULE_NAME, "Unable to open stat: %s", strerror(errno));
+        (void)snprintf(path, sizeof(path), "%s/proc/stat", opts->root_dir);
+        if (pfile_open(&opts->stat, path) == -1)
+            return -1;
+    }
+    // only the cpu lines at the head of the file are needed
+    if (pfile_read(&opts->stat, opts->n_cpus) <= 0)
+    {
+        M_ERROR(MODULE_NAME, "Unable to read stat: %s", strerror(errno));
         return -1;
     }
+    ptr = opts->stat.data;
     for (i = 0; i < opts->n_cpus; i++)
     {
-        ret = read_line(fd, buf, MAX_BUF);
-        if (ret > 0 && buf[0] == 'c' && buf[1] == 'p' && buf[2] == 'u')
+        if (ptr[0] == 'c' && ptr[1] == 'p' && ptr[2] == 'u')
         {
-            token = strtok(buf, d);
+            cpu = &opts->cpus[i];
+            ptr += 3;
+            while (*ptr >= '0' && *ptr <= '9')
+                ptr++;
             sum = 0;
-            j = 0;
-            while (token != NULL)
+            for (j = 0; j < CPU_STAT_COLS; j++)
             {
-                token = strtok(NULL, d);
-                if (token != NULL)
-                {
-                    sum += strtoul(token, NULL, 10);
-                    if (j == 3)
-                        idle = strtoul(token, NULL, 10);
-                    j++;
-                }
+                col = strtoul(ptr, &end, 10);
+                if (end == ptr)
+                    col = 0;
+                ptr = end;
+                // iowait may go backwards on NO_HZ kernels, a negative delta counts as 0
+                delta[j] = col >= cpu->last[j] ? col - cpu->last[j] : 0;
+                cpu->last[j] = col;
+                sum += delta[j];
             }
-            opts->cpus[i].percent = 100 - (idle - opts->cpus[i].last_idle) * 100.0 / (sum - opts->cpus[i].last_sum);
-            opts->cpus[i].last_idle = idle;
-            opts->cpus[i].last_sum = sum;
+            cpu->percent = sum > 0 ? 100 - delta[3] * 100.0 / sum : 0.0;
+            for (j = 0; j < CPU_STAT_COLS; j++)
+            {
+                cpu->times[j] = sum > 0 ? delta[j] * 100.0 / sum : 0.0;
+            }
+            ptr = strchr(ptr, '\n');
+            if (ptr == NULL)
+            {
+                i++;
+                break;
+            }
+            ptr++;
         }
         else
         {
@@ -315,7 +319,6 @@ static int read_cpu_info(app_data_t *opts)
             break;
         }
     }
-    (void)close(fd);
     if (i == 0)
     {
         M_ERROR(MODULE_NAME, "No CPU info found");
@@ -324,39 +327,71 @@ static int read_cpu_info(app_data_t *opts)
     return i;
 }
 
-static int read_mem_info(app_data_t *opts)
+static int read_cpu_freq(app_data_t *opts)
 {
-    int fd, ret;
-    const char d[2] = " ";
-    unsigned long data[7];
-    char *token;
-    fd = open("/proc/meminfo", O_RDONLY);
-    if (fd < 0)
+    char data[32];
+    ssize_t ret;
+    sys_cpu_t *cpu;
+    if (!opts->cpu_freq)
     {
-        M_ERROR(MODULE_NAME, "Unable to open meminfo: %s", strerror(errno));
-        return -1;
+        return 0;
     }
-    for (int i = 0; i < 7; i++)
+    // cpus[0] is the aggregated entry
+    for (int i = 1; i < opts->n_cpus; i++)
     {
-        ret = read_line(fd, buf, MAX_BUF);
-        token = strtok(buf, d);
-        token = strtok(NULL, d);
-        if (token != NULL)
+        cpu = &opts->cpus[i];
+        if (cpu->freq_fd < 0)
+            continue;
+        ret = pread(cpu->freq_fd, data, sizeof(data) - 1, 0);
+        if (ret <= 0)
         {
-            data[i] = (unsigned long)strtoul(token, NULL, 10);
+            M_ERROR(MODULE_NAME, "Unable to read frequency of cpu%d: %s", i - 1, strerror(errno));
+            continue;
         }
-        else
+        data[ret] = '\0';
+        cpu->freq = (uint32_t)strtoul(data, NULL, 10);
+    }
+    return 0;
+}
+
+static int read_mem_info(app_data_t *opts)
+{
+    unsigned long data[7];
+    char *ptr;
+    char path[MAX_BUF * 2];
+    int i = 0;
+    if (opts->meminfo.fd < 0)
+    {
+        (void)snprintf(path, sizeof(path), "%s/proc/meminfo", opts->root_dir);
+        if (pfile_open(&opts->meminfo, path) == -1)
         {
-            data[i] = 0;
+            M_ERROR(MODULE_NAME, "Unable to open meminfo: %s", strerror(errno));
+            return -1;
         }
-        if (i == 4)
+    }
+    // MemTotal, MemFree, MemAvailable, Buffers, Cached then SwapTotal and SwapFree 9 lines later
+    if (pfile_read(&opts->meminfo, 16) <= 0)
+    {
+        M_ERROR(MODULE_NAME, "Unable to read meminfo: %s", strerror(errno));
+        return -1;
+    }
+    ptr = opts->meminfo.data;
+    for (int line = 0; line < 16 && i < 7 && ptr != NULL; line++)
+    {
+        if (line < 5 || line >= 14)
         {
-            for (int j = 0; j < 9; j++)
-            {
-                ret = read_line(fd, buf, MAX_BUF);
-                // skip 10 line
-            }
+            ptr = strchr(ptr, ':');
+            if (ptr == NULL)
+                break;
+            data[i++] = (unsigned long)strtoul(ptr + 1, NULL, 10);
         }
+        ptr = strchr(ptr, '\n');
+        if (ptr != NULL)
+            ptr++;
+    }
+    for (; i < 7; i++)
+    {
+        data[i] = 0;
     }
     opts->mem.m_total = data[0];
     opts->mem.m_free = data[1];
@@ -365,101 +400,92 @@ static int read_mem_info(app_data_t *opts)
     opts->mem.m_cache = data[4];
     opts->mem.m_swap_total = data[5];
     opts->mem.m_swap_free = data[6];
-    (void)ret;
-    (void)close(fd);
-
-    /*printf("total: %d used: %d, free: %d buffer/cache: %d, available: %d \n",
-        opts->mem.m_total / 1024,
-        (opts->mem.m_total - opts->mem.m_free - opts->mem.m_buffer-opts->mem.m_cache)/1024,
-        opts->mem.m_free/1024,
-        (opts->mem.m_buffer+opts->mem.m_cache)/1024,
-        opts->mem.m_available/1024);*/
     return 0;
 }
 
-static int read_temp_file(const char *file, uint32_t *output)
+static int read_temp_file(pfile_t *pf, const char *file, uint32_t *output)
 {
-    int fd, ret;
     if (file[0] != '\0')
     {
-        fd = open(file, O_RDONLY);
-        if (fd < 0)
+        if (pf->fd < 0 && pfile_open(pf, file) == -1)
         {
             M_ERROR(MODULE_NAME, "Unable to open temp file %s : %s", file, strerror(errno));
             return -1;
         }
-        (void)memset(buf, '\0', sizeof(buf));
-        ret = read(fd, buf, MAX_BUF);
-        if (ret < 0)
+        if (pfile_read(pf, 0) < 0)
         {
             M_ERROR(MODULE_NAME, "Unable to read temperature: %s", strerror(errno));
-            (void)close(fd);
             return -1;
         }
-        *output = (uint32_t)atoi(buf);
-        (void)close(fd);
+        *output = (uint32_t)atoi(pf->data);
     }
     return 0;
 }
 
 static int read_cpu_temp(app_data_t *opts)
 {
-    if (read_temp_file(opts->temp.cpu_temp_file, &opts->temp.cpu) == -1)
+    if (read_temp_file(&opts->temp.cpu_file, opts->temp.cpu_temp_file, &opts->temp.cpu) == -1)
     {
         return -1;
     }
-    return read_temp_file(opts->temp.gpu_temp_file, &opts->temp.gpu);
+    return read_temp_file(&opts->temp.gpu_file, opts->temp.gpu_temp_file, &opts->temp.gpu);
 }
 
 static int read_net_statistic(app_data_t *opts)
 {
-    int fd, ret;
+    sys_net_inf_t *intf;
     float period;
     long unsigned int bytes;
+    char path[MAX_BUF * 2];
+    struct timespec now;
 
-    period = ((float)opts->sample_period.it_value.tv_nsec) / 1.0e9;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (opts->net.last_read.tv_sec == 0 && opts->net.last_read.tv_nsec == 0)
+    {
+        period = ((float)opts->sample_period.it_value.tv_sec) + ((float)opts->sample_period.it_value.tv_nsec) / 1.0e9;
+    }
+    else
+    {
+        period = (float)(now.tv_sec - opts->net.last_read.tv_sec) + ((float)(now.tv_nsec - opts->net.last_read.tv_nsec)) / 1.0e9;
+    }
+    opts->net.last_read = now;
+    if (period <= 0.0)
+    {
+        period = 1.0e-3;
+    }
     for (int i = 0; i < opts->net.n_intf; i++)
     {
+        intf = &opts->net.interfaces[i];
         // rx
-        (void)snprintf(buf, MAX_BUF - 1, NET_INF_STAT_PT, opts->net.interfaces[i].name, "rx_bytes");
-        fd = open(buf, O_RDONLY);
-        if (fd < 0)
+        if (intf->rx_file.fd < 0)
         {
-            M_ERROR(MODULE_NAME, "Unable to open %s: %s", buf, strerror(errno));
-            return -1;
+            (void)snprintf(path, sizeof(path), NET_INF_STAT_PT, opts->root_dir, intf->name, "rx_bytes");
+            if (pfile_open(&intf->rx_file, path) == -1)
+                return -1;
         }
-        // read data to buff
-        (void)memset(buf, '\0', MAX_BUF);
-        ret = read(fd, buf, MAX_BUF);
-        (void)close(fd);
-        if (ret <= 0)
+        if (pfile_read(&intf->rx_file, 0) <= 0)
         {
-            M_ERROR(MODULE_NAME, "Unable to read RX data of %s: %s", opts->net.interfaces[i].name, strerror(errno));
+            M_ERROR(MODULE_NAME, "Unable to read RX data of %s: %s", intf->name, strerror(errno));
             return -1;
         }
-        bytes = (unsigned long)strtoul(buf, NULL, 10);
-        opts->net.interfaces[i].rx_rate = ((float)(bytes - opts->net.interfaces[i].rx) / period);
-        opts->net.interfaces[i].rx = bytes;
+        bytes = (unsigned long)strtoul(intf->rx_file.data, NULL, 10);
+        intf->rx_rate = ((float)(bytes - intf->rx) / period);
+        intf->rx = bytes;
 
-        (void)snprintf(buf, MAX_BUF - 1, NET_INF_STAT_PT, opts->net.interfaces[i].name, "tx_bytes");
-        fd = open(buf, O_RDONLY);
-        if (fd < 0)
+        if (intf->tx_file.fd < 0)
         {
-            M_ERROR(MODULE_NAME, "Unable to open %s: %s", buf, strerror(errno));
-            return -1;
+            (void)snprintf(path, sizeof(path), NET_INF_STAT_PT, opts->root_dir, intf->name, "tx_bytes");
+            if (pfile_open(&intf->tx_file, path) == -1)
+                return -1;
         }
-        // read data to buff
-        (void)memset(buf, '\0', MAX_BUF);
-        ret = read(fd, buf, MAX_BUF);
-        (void)close(fd);
-        if (ret <= 0)
+        if (pfile_read(&intf->tx_file, 0) <= 0)
         {
-            M_ERROR(MODULE_NAME, "Unable to read TX data of %s: %s", opts->net.interfaces[i].name, strerror(errno));
+            M_ERROR(MODULE_NAME, "Unable to read TX data of %s: %s", intf->name, strerror(errno));
             return -1;
         }
-        bytes = (unsigned long)strtoul(buf, NULL, 10);
-        opts->net.interfaces[i].tx_rate = ((float)(bytes - opts->net.interfaces[i].tx) / period);
-        opts->net.interfaces[i].tx = bytes;
+        bytes = (unsigned long)strtoul(intf->tx_file.data, NULL, 10);
+        intf->tx_rate = ((float)(bytes - intf->tx) / period);
+        intf->tx = bytes;
     }
     return 0;
 }
@@ -478,119 +504,289 @@ static int read_disk_usage(app_data_t *opts)
     return 0;
 }
 
-static int log_to_file(app_data_t *opts)
+static void encode_json(app_data_t *opts, obuf_t *ob, const struct timeval *now)
 {
-    int ret, fd = -1, use_stdout = 0;
-    char out_buf[1024];
-    char net_buf[MAX_BUF];
-    (void)memset(out_buf, 0, sizeof(out_buf));
-    (void)memset(net_buf, 0, sizeof(net_buf));
-    if (opts->data_file_out[0] == '\0')
-    {
-        return 0;
-    }
-    // check if we use stdout
-    if (strncmp(opts->data_file_out, "stdout", 6) == 0)
+    sys_net_inf_t *intf;
+    OBUF_LIT(ob, "{\"stamp_sec\": ");
+    obuf_u64(ob, (uint64_t)now->tv_sec);
+    OBUF_LIT(ob, ",\"stamp_usec\": ");
+    obuf_u64(ob, (uint64_t)now->tv_usec);
+    if (opts->host_name[0] != '\0')
     {
-        // out put to stdout
-        use_stdout = 1;
-    }
-    else if (strncmp(opts->data_file_out, "sock:", 5) == 0)
-    {
-        // Unix domain socket
-        fd = open_unix_socket(opts->data_file_out + 5);
+        OBUF_LIT(ob, ",\"host\":\"");
+        obuf_puts(ob, opts->host_name);
+        obuf_putc(ob, '"');
     }
+    OBUF_LIT(ob, ",\"battery\": ");
+    if (isnan(opts->bat_stat.read_voltage))
+        OBUF_LIT(ob, "null");
+    else
+        obuf_fixed(ob, opts->bat_stat.read_voltage * opts->bat_stat.ratio, 3);
+    OBUF_LIT(ob, ",\"battery_percent\": ");
+    if (isnan(opts->bat_stat.percent))
+        OBUF_LIT(ob, "null");
     else
+        obuf_fixed(ob, opts->bat_stat.percent, 3);
+    if (opts->batsample.started)
     {
-        // open regular file
-        fd = open(opts->data_file_out, O_CREAT | O_WRONLY | O_APPEND | O_NONBLOCK, 0644);
+        OBUF_LIT(ob, ",\"battery_current\": ");
+        if (isnan(opts->bat_value.current))
+            OBUF_LIT(ob, "null");
+        else
+            obuf_fixed(ob, opts->bat_value.current, 1);
+        OBUF_LIT(ob, ",\"battery_time_to_empty\": ");
+        if (isnan(opts->bat_value.time_to_empty))
+            OBUF_LIT(ob, "null");
+        else
+            obuf_u64(ob, (uint64_t)opts->bat_value.time_to_empty);
     }
-    if (fd < 0 && !use_stdout)
+    OBUF_LIT(ob, ",\"battery_max_voltage\": ");
+    obuf_i64(ob, opts->bat_stat.max_voltage);
+    OBUF_LIT(ob, ",\"battery_min_voltage\": ");
+    obuf_i64(ob, opts->bat_stat.min_voltage);
+    OBUF_LIT(ob, ",\"cpu_temp\": ");
+    obuf_i64(ob, (int32_t)opts->temp.cpu);
+    OBUF_LIT(ob, ",\"gpu_temp\": ");
+    obuf_i64(ob, (int32_t)opts->temp.gpu);
+    OBUF_LIT(ob, ",\"cpu_usages\":[");
+    for (int i = 0; i < opts->n_cpus; i++)
     {
-        M_ERROR(MODULE_NAME, "Unable to open output file: %s", strerror(errno));
-        return -1;
+        if (i > 0)
+            obuf_putc(ob, ',');
+        obuf_fixed(ob, opts->cpus[i].percent, 3);
     }
-    (void)memset(buf, '\0', MAX_BUF);
-    char *ptr = buf;
-    // CPU
-    size_t len = 0;
-    for (int i = 0; i < opts->n_cpus; i++)
+    obuf_putc(ob, ']');
+    if (opts->cpu_times)
     {
-        if (MAX_BUF - len - 1 <= 0)
+        OBUF_LIT(ob, ",\"cpu_times\":[");
+        for (int i = 0; i < opts->n_cpus; i++)
         {
-            break;
+            obuf_put(ob, i > 0 ? ",[" : "[", i > 0 ? 2 : 1);
+            for (int j = 0; j < CPU_STAT_COLS; j++)
+            {
+                if (j > 0)
+                    obuf_putc(ob, ',');
+                obuf_fixed(ob, opts->cpus[i].times[j], 3);
+            }
+            obuf_putc(ob, ']');
         }
-        snprintf(ptr, MAX_BUF - len - 1, "%.3f,", opts->cpus[i].percent);
-        len = strlen(buf);
-        ptr = buf + len;
+        obuf_putc(ob, ']');
     }
-    buf[len - 1] = '\0';
-
-    // NET
-    len = 0;
-    ptr = net_buf;
-    for (int i = 0; i < opts->net.n_intf; i++)
+    if (opts->cpu_freq)
     {
-        if (MAX_BUF - len - 1 < strlen(JSON_NET_FMT))
+        OBUF_LIT(ob, ",\"cpu_freq\":[");
+        for (int i = 1; i < opts->n_cpus; i++)
         {
-            break;
+            if (i > 1)
+                obuf_putc(ob, ',');
+            obuf_u64(ob, opts->cpus[i].freq);
         }
-        snprintf(ptr, MAX_BUF - len - 1, JSON_NET_FMT,
-                 opts->net.interfaces[i].name,
-                 opts->net.interfaces[i].rx,
-                 opts->net.interfaces[i].tx,
-                 opts->net.interfaces[i].rx_rate,
-                 opts->net.interfaces[i].tx_rate);
-        len = strlen(net_buf);
-        ptr = net_buf + len;
+        obuf_putc(ob, ']');
     }
-    net_buf[len - 1] = '\0';
+    OBUF_LIT(ob, ",\"mem_total\": ");
+    obuf_u64(ob, opts->mem.m_total);
+    OBUF_LIT(ob, ",\"mem_free\": ");
+    obuf_u64(ob, opts->mem.m_free);
+    OBUF_LIT(ob, ",\"mem_used\": ");
+    obuf_u64(ob, opts->mem.m_total - opts->mem.m_free - opts->mem.m_buffer - opts->mem.m_cache);
+    OBUF_LIT(ob, ",\"mem_buff_cache\": ");
+    obuf_u64(ob, opts->mem.m_buffer + opts->mem.m_cache);
+    OBUF_LIT(ob, ",\"mem_available\": ");
+    obuf_u64(ob, opts->mem.m_available);
+    OBUF_LIT(ob, ",\"mem_swap_total\": ");
+    obuf_u64(ob, opts->mem.m_swap_total);
+    OBUF_LIT(ob, ",\"mem_swap_free\": ");
+    obuf_u64(ob, opts->mem.m_swap_free);
+    OBUF_LIT(ob, ",\"disk_total\": ");
+    obuf_u64(ob, opts->disk.d_total);
+    OBUF_LIT(ob, ",\"disk_free\": ");
+    obuf_u64(ob, opts->disk.d_free);
+    OBUF_LIT(ob, ",\"net\":[");
+    for (int i = 0; i < opts->net.n_intf; i++)
+    {
+        intf = &opts->net.interfaces[i];
+        if (i > 0)
+            obuf_putc(ob, ',');
+        OBUF_LIT(ob, "{\"name\":\"");
+        obuf_puts(ob, intf->name);
+        OBUF_LIT(ob, "\",\"rx\": ");
+        obuf_u64(ob, intf->rx);
+        OBUF_LIT(ob, ",\"tx\": ");
+        obuf_u64(ob, intf->tx);
+        OBUF_LIT(ob, ",\"rx_rate\": ");
+        obuf_fixed(ob, intf->rx_rate, 3);
+        OBUF_LIT(ob, ",\"tx_rate\": ");
+        obuf_fixed(ob, intf->tx_rate, 3);
+        obuf_putc(ob, '}');
+    }
+    obuf_putc(ob, ']');
+    perf_encode(&opts->perf, ob);
+    power_encode(&opts->power, ob);
+    sched_encode(&opts->sched, ob);
+    numa_encode(&opts->numa, ob);
+    sockstat_encode(&opts->sockstat, ob);
+    vmstat_encode(&opts->vmstat, ob);
+    anomaly_encode(&opts->anomaly, ob);
+    output_encode_stats(&opts->out, ob);
+    rt_jitter_encode(&opts->jitter, ob);
+    if (opts->subsample.tfd >= 0)
+    {
+        subsample_encode(&opts->subsample, ob);
+    }
+    if (opts->adaptive.enabled)
+    {
+        OBUF_LIT(ob, ",\"period_ms\": ");
+        obuf_u64(ob, opts->adaptive.period_ms);
+        OBUF_LIT(ob, ",\"wakeups_per_min\": ");
+        obuf_fixed(ob, adaptive_wakeups_per_min(&opts->adaptive), 1);
+    }
+    OBUF_LIT(ob, "}\n");
+}
 
+static void encode_record(void *user, obuf_t *ob, const struct timeval *now)
+{
+    encode_json((app_data_t *)user, ob, now);
+}
+
+static void log_to_file(app_data_t *opts)
+{
     struct timeval now;
+    if (opts->out.n_sinks == 0)
+    {
+        return;
+    }
     gettimeofday(&now, NULL);
-    snprintf(out_buf, sizeof(out_buf), JSON_FMT,
-             now.tv_sec,
-             now.tv_usec,
-             opts->bat_stat.read_voltage * opts->bat_stat.ratio,
-             opts->bat_stat.percent,
-             opts->bat_stat.max_voltage,
-             opts->bat_stat.min_voltage,
-             opts->temp.cpu,
-             opts->temp.gpu,
-             buf,
-             opts->mem.m_total,
-             opts->mem.m_free,
-             (opts->mem.m_total - opts->mem.m_free - opts->mem.m_buffer - opts->mem.m_cache),
-             opts->mem.m_buffer + opts->mem.m_cache,
-             opts->mem.m_available,
-             opts->mem.m_swap_total,
-             opts->mem.m_swap_free,
-             opts->disk.d_total,
-             opts->disk.d_free,
-             net_buf);
-    out_buf[strlen(out_buf)] = '\n';
-    ret = 0;
-    if (use_stdout)
-    {
-        printf("%s", out_buf);
+    output_record(&opts->out, opts->metrics, METRIC_COUNT, &now);
+}
+
+static void emit_record(void *user, obuf_t *event)
+{
+    app_data_t *opts = (app_data_t *)user;
+    output_event(&opts->out, event);
+}
+
+static void collect_metrics(app_data_t *opts)
+{
+    double *m = opts->metrics;
+    float volt = opts->bat_stat.read_voltage * opts->bat_stat.ratio;
+    double rx = 0.0, tx = 0.0;
+    // battery readings below the cut off voltage are not trusted, NaN when the last read failed
+    if (opts->bat_stat.bat_in[0] == '\0' || isnan(volt) || volt < opts->bat_stat.cutoff_voltage)
+    {
+        m[METRIC_BATTERY] = NAN;
+        m[METRIC_BATTERY_PERCENT] = NAN;
     }
     else
     {
-        ret = guard_write(fd, out_buf, strlen(out_buf));
-        if (ret <= 0)
-        {
-            M_ERROR(MODULE_NAME, "Unable to write data to output file");
-            ret = -1;
-        }
-        if (ret != (int)strlen(out_buf))
-        {
-            M_ERROR(MODULE_NAME, "Unable to write all battery info to output file");
-            ret = -1;
-        }
+        m[METRIC_BATTERY] = volt;
+        m[METRIC_BATTERY_PERCENT] = opts->bat_stat.percent;
     }
-    if (fd > 0)
-        (void)close(fd);
-    return ret;
+    m[METRIC_CPU_TEMP] = opts->temp.cpu;
+    m[METRIC_GPU_TEMP] = opts->temp.gpu;
+    m[METRIC_CPU_USAGE] = opts->cpus[0].percent;
+    m[METRIC_MEM_TOTAL] = opts->mem.m_total;
+    m[METRIC_MEM_FREE] = opts->mem.m_free;
+    m[METRIC_MEM_USED] = (double)(opts->mem.m_total - opts->mem.m_free - opts->mem.m_buffer - opts->mem.m_cache);
+    m[METRIC_MEM_BUFF_CACHE] = opts->mem.m_buffer + opts->mem.m_cache;
+    m[METRIC_MEM_AVAILABLE] = opts->mem.m_available;
+    m[METRIC_MEM_SWAP_TOTAL] = opts->mem.m_swap_total;
+    m[METRIC_MEM_SWAP_FREE] = opts->mem.m_swap_free;
+    m[METRIC_DISK_TOTAL] = opts->disk.d_total;
+    m[METRIC_DISK_FREE] = opts->disk.d_free;
+    for (int i = 0; i < opts->net.n_intf; i++)
+    {
+        rx += opts->net.interfaces[i].rx_rate;
+        tx += opts->net.interfaces[i].tx_rate;
+    }
+    m[METRIC_NET_RX_RATE] = rx;
+    m[METRIC_NET_TX_RATE] = tx;
+    m[METRIC_CPU_IOWAIT] = opts->cpus[0].times[4];
+    m[METRIC_CPU_STEAL] = opts->cpus[0].times[7];
+    m[METRIC_POWER] = power_total(&opts->power);
+    m[METRIC_SWAP_IN_RATE] = vmstat_rate(&opts->vmstat, VMSTAT_PSWPIN);
+    m[METRIC_SWAP_OUT_RATE] = vmstat_rate(&opts->vmstat, VMSTAT_PSWPOUT);
+    m[METRIC_MAJOR_FAULT_RATE] = vmstat_rate(&opts->vmstat, VMSTAT_PGMAJFAULT);
+}
+
+typedef int (*source_fn_t)(app_data_t *opts, pfile_t *pf);
+
+/*apply fn to every procfs/sysfs source read at each sample, -1 if any call failed*/
+static int for_each_source(app_data_t *opts, source_fn_t fn)
+{
+    int ret = 0;
+    ret |= fn(opts, &opts->stat);
+    ret |= fn(opts, &opts->meminfo);
+    ret |= fn(opts, &opts->bat_stat.file);
+    ret |= fn(opts, &opts->temp.cpu_file);
+    ret |= fn(opts, &opts->temp.gpu_file);
+    for (int i = 0; i < opts->net.n_intf; i++)
+    {
+        ret |= fn(opts, &opts->net.interfaces[i].rx_file);
+        ret |= fn(opts, &opts->net.interfaces[i].tx_file);
+    }
+    for (int i = 0; i < opts->power.n_zones; i++)
+    {
+        ret |= fn(opts, &opts->power.zones[i].energy);
+    }
+    ret |= fn(opts, &opts->sched.stat_file);
+    ret |= fn(opts, &opts->sched.softirq.file);
+    ret |= fn(opts, &opts->sched.irq.file);
+    for (int i = 0; i < opts->numa.n_nodes; i++)
+    {
+        ret |= fn(opts, &opts->numa.nodes[i].meminfo);
+        ret |= fn(opts, &opts->numa.nodes[i].numastat);
+    }
+    ret |= fn(opts, &opts->sockstat.snmp_file);
+    ret |= fn(opts, &opts->vmstat.file);
+    return ret ? -1 : 0;
+}
+
+static int add_batch_read(app_data_t *opts, pfile_t *pf)
+{
+    return uring_add(&opts->uring, pf);
+}
+
+/*hand every source opened by the first sample to the io_uring backend*/
+static void setup_batch_reads(app_data_t *opts)
+{
+    (void)for_each_source(opts, add_batch_read);
+    if (uring_setup(&opts->uring) == -1)
+    {
+        opts->uring.enabled = 0;
+    }
+}
+
+static int freeze_source(app_data_t *opts, pfile_t *pf)
+{
+    (void)opts;
+    if (pf->fd < 0)
+        return 0;
+    // twice the first read, longer content is cut (see pfile_read)
+    return pfile_freeze(pf, pf->len * 2 + 1);
+}
+
+/**
+ * the first sample sized every buffer: allocate the headroom now and
+ * never grow them afterward, so that nothing is allocated once memory
+ * is locked. Content that outgrows a buffer is cut or dropped.
+ */
+static void freeze_buffers(app_data_t *opts)
+{
+    int ret = for_each_source(opts, freeze_source);
+    opts->uring.frozen = 1;
+    ret |= sched_reserve(&opts->sched);
+    ret |= output_reserve(&opts->out);
+    ret |= obuf_freeze(&opts->alert.event, RT_EVENT_SIZE);
+    ret |= obuf_freeze(&opts->anomaly.event, RT_EVENT_SIZE);
+    if (ret)
+        M_ERROR(MODULE_NAME, "Real-time mode: unable to preallocate every buffer");
+}
+
+static void set_period(struct itimerspec *spec, unsigned long ms)
+{
+    spec->it_interval.tv_sec = ms / 1000;
+    spec->it_interval.tv_nsec = (ms % 1000) * 1000000;
+    spec->it_value = spec->it_interval;
 }
 
 static int ini_handle(void *user_data, const char *section, const char *name, const char *value)
@@ -601,7 +797,17 @@ static int ini_handle(void *user_data, const char *section, const char *name, co
     char *token;
 
     app_data_t *opts = (app_data_t *)user_data;
-    if (EQU(name, "battery_max_voltage"))
+    if (file_sink_config(&opts->fsink, name, value) || output_config(&opts->out, name, value) ||
+        rt_config(&opts->rt, name, value) || adaptive_config(&opts->adaptive, name, value) || subsample_config(&opts->subsample, name, value) ||
+        uring_config(&opts->uring, name, value) || sched_config(&opts->sched, name, value) ||
+        sockstat_config(&opts->sockstat, name, value) || vmstat_config(&opts->vmstat, name, value) ||
+        subscribe_config(&opts->subscribe, name, value) ||
+        history_config(&opts->history, name, value) || anomaly_config(&opts->anomaly, name, value) ||
+        batsample_config(&opts->batsample, name, value))
+    {
+        return 1;
+    }
+    else if (EQU(name, "battery_max_voltage"))
     {
         opts->bat_stat.max_voltage = atoi(value);
     }
@@ -623,9 +829,8 @@ static int ini_handle(void *user_data, const char *section, const char *name, co
     }
     else if (EQU(name, "sample_period"))
     {
-        period = strtoul(value, NULL, 10) * 1e6;
-        opts->sample_period.it_interval.tv_nsec = period;
-        opts->sample_period.it_value.tv_nsec = period;
+        period = strtoul(value, NULL, 10);
+        set_period(&opts->sample_period, period);
     }
     else if (EQU(name, "cpu_core_number"))
     {
@@ -635,6 +840,61 @@ static int ini_handle(void *user_data, const char *section, const char *name, co
     {
         opts->pwoff_cd = atoi(value);
     }
+    else if (EQU(name, "jitter_stats"))
+    {
+        opts->jitter.enabled = atoi(value);
+    }
+    else if (EQU(name, "root_dir"))
+    {
+        (void)strncpy(opts->root_dir, value, MAX_BUF - 1);
+    }
+    else if (EQU(name, "host_name"))
+    {
+        if (EQU(value, "auto"))
+            (void)gethostname(opts->host_name, sizeof(opts->host_name) - 1);
+        else
+            (void)strncpy(opts->host_name, value, sizeof(opts->host_name) - 1);
+    }
+    else if (EQU(name, "mode"))
+    {
+        opts->aggregator_mode = EQU(value, "aggregator");
+    }
+    else if (EQU(name, "aggregator_listen"))
+    {
+        (void)strncpy(opts->agg.listen, value, MAX_BUF - 1);
+    }
+    else if (EQU(name, "aggregator_stale_ms"))
+    {
+        opts->agg.stale_ms = atoi(value);
+    }
+    else if (EQU(name, "aggregator_expire_ms"))
+    {
+        opts->agg.expire_ms = atoi(value);
+    }
+    else if (EQU(name, "cpu_times"))
+    {
+        opts->cpu_times = atoi(value);
+    }
+    else if (EQU(name, "cpu_freq"))
+    {
+        opts->cpu_freq = atoi(value);
+    }
+    else if (EQU(name, "numa_stats"))
+    {
+        opts->numa.enabled = atoi(value);
+    }
+    else if (EQU(name, "power_zones"))
+    {
+        opts->power.enabled = atoi(value);
+    }
+    else if (EQU(name, "perf_counters"))
+    {
+        opts->perf_counters = atoi(value);
+    }
+    else if (EQU(name, "alert"))
+    {
+        (void)alert_add(&opts->alert, value);
+    }
     else if (EQU(name, "power_off_percent"))
     {
         opts->power_off_percent = (uint8_t)atoi(value);
@@ -685,12 +945,20 @@ static int load_config(app_data_t *opts)
     (void)memset(opts->temp.cpu_temp_file, '\0', MAX_BUF);
     (void)memset(opts->temp.gpu_temp_file, '\0', MAX_BUF);
     opts->pwoff_cd = 5;
-    opts->sample_period.it_interval.tv_sec = 0;
-    opts->sample_period.it_interval.tv_nsec = 3e+8;
-    opts->sample_period.it_value.tv_sec = 0;
-    opts->sample_period.it_value.tv_nsec = 3e+8;
+    set_period(&opts->sample_period, 300);
     opts->cpus = NULL;
     opts->n_cpus = 2;
+    opts->cpu_times = 0;
+    opts->cpu_freq = 0;
+    pfile_init(&opts->stat);
+    (void)memset(opts->root_dir, '\0', MAX_BUF);
+    (void)memset(opts->host_name, '\0', sizeof(opts->host_name));
+    opts->aggregator_mode = 0;
+    (void)memset(&opts->rt, 0, sizeof(opts->rt));
+    (void)memset(&opts->jitter, 0, sizeof(opts->jitter));
+    aggregator_init(&opts->agg);
+    opts->agg.emit = emit_record;
+    opts->agg.user = opts;
 
     //battery
     (void)memset(opts->bat_stat.bat_in, '\0', MAX_BUF);
@@ -705,8 +973,44 @@ static int load_config(app_data_t *opts)
     (void)memset(&opts->mem, '\0', sizeof(opts->mem));
     (void)memset(&opts->temp, '\0', sizeof(opts->temp));
     (void)memset(&opts->net, '\0', sizeof(opts->net));
+    pfile_init(&opts->meminfo);
+    pfile_init(&opts->bat_stat.file);
+    pfile_init(&opts->temp.cpu_file);
+    pfile_init(&opts->temp.gpu_file);
+    for (int i = 0; i < MAX_NETWORK_INF; i++)
+    {
+        pfile_init(&opts->net.interfaces[i].rx_file);
+        pfile_init(&opts->net.interfaces[i].tx_file);
+    }
     (void)memset(&opts->disk, '\0', sizeof(opts->disk));
     opts->disk.mount_path[0] = '/';
+    file_sink_init(&opts->fsink);
+    output_init(&opts->out);
+    opts->out.encode_json = encode_record;
+    opts->out.user = opts;
+    opts->out.host = opts->host_name;
+    alert_init(&opts->alert);
+    adaptive_init(&opts->adaptive);
+    subsample_init(&opts->subsample);
+    uring_init(&opts->uring);
+    sched_init(&opts->sched);
+    sockstat_init(&opts->sockstat);
+    vmstat_init(&opts->vmstat);
+    subscribe_init(&opts->subscribe);
+    history_init(&opts->history);
+    anomaly_init(&opts->anomaly);
+    batsample_init(&opts->batsample);
+    (void)memset(&opts->bat_value, 0, sizeof(opts->bat_value));
+    opts->bat_value.current = NAN;
+    opts->bat_value.time_to_empty = NAN;
+    (void)memset(&opts->perf, 0, sizeof(opts->perf));
+    (void)memset(&opts->power, 0, sizeof(opts->power));
+    (void)memset(&opts->numa, 0, sizeof(opts->numa));
+    opts->perf_counters = 0;
+    opts->alert.emit = emit_record;
+    opts->alert.user = opts;
+    opts->anomaly.emit = emit_record;
+    opts->anomaly.user = opts;
 
     M_LOG(MODULE_NAME, "Use configuration: %s", opts->conf_file);
     if (ini_parse(opts->conf_file, ini_handle, opts) < 0)
@@ -725,19 +1029,33 @@ static int load_config(app_data_t *opts)
                 opts->bat_stat.cutoff_voltage);
         return -1;
     }
+    // the battery protection is a built-in alert rule
+    if (opts->bat_stat.bat_in[0] != '\0')
+    {
+        (void)snprintf(buf, MAX_BUF, "power_off: battery_percent <= %d for %d => exec:poweroff",
+                       opts->power_off_percent, opts->pwoff_cd);
+        if (alert_add(&opts->alert, buf) == -1)
+        {
+            return -1;
+        }
+    }
     return 0;
 }
 
 int main(int argc, char *const *argv)
 {
-    int ret, tfd, count_down;
+    int ret, tfd, rt_active = 0, first = 1;
     float volt;
     uint64_t expirations_count;
+    uint32_t new_period;
+    double adaptive_in[ADAPTIVE_N_SIGNALS];
+    struct timeval now;
     app_data_t opts;
     LOG_INIT(MODULE_NAME);
     signal(SIGPIPE, SIG_IGN);
     signal(SIGABRT, SIG_IGN);
     signal(SIGINT, int_handler);
+    signal(SIGTERM, int_handler);
     (void)strncpy(opts.conf_file, DEFAULT_CONF_FILE, MAX_BUF - 1);
     while ((ret = getopt(argc, argv, "hf:")) != -1)
     {
@@ -770,13 +1088,24 @@ int main(int argc, char *const *argv)
     M_LOG(MODULE_NAME, "Battery Min voltage: %d", opts.bat_stat.min_voltage);
     M_LOG(MODULE_NAME, "Battery Cut off voltage: %d", opts.bat_stat.cutoff_voltage);
     M_LOG(MODULE_NAME, "Battery Divide ratio: %.3f", opts.bat_stat.ratio);
-    M_LOG(MODULE_NAME, "Sample period: %d", (int)(opts.sample_period.it_value.tv_nsec / 1e6));
+    M_LOG(MODULE_NAME, "Sample period: %d", (int)(opts.sample_period.it_value.tv_sec * 1000 + opts.sample_period.it_value.tv_nsec / 1000000));
     M_LOG(MODULE_NAME, "CPU cores: %d", opts.n_cpus);
     M_LOG(MODULE_NAME, "Power off count down: %d", opts.pwoff_cd);
     M_LOG(MODULE_NAME, "CPU temp. input: %s", opts.temp.cpu_temp_file);
     M_LOG(MODULE_NAME, "GPU temp. input: %s", opts.temp.gpu_temp_file);
     M_LOG(MODULE_NAME, "Poweroff percent: %d", opts.power_off_percent);
 
+    if (opts.adaptive.enabled)
+    {
+        // start from the configured period, clamped into [min, max]
+        adaptive_start(&opts.adaptive, opts.sample_period.it_value.tv_sec * 1000 + opts.sample_period.it_value.tv_nsec / 1000000);
+        set_period(&opts.sample_period, opts.adaptive.period_ms);
+        M_LOG(MODULE_NAME, "Adaptive sampling: %u - %u ms", opts.adaptive.min_ms, opts.adaptive.max_ms);
+    }
+    else
+    {
+        adaptive_start(&opts.adaptive, opts.sample_period.it_value.tv_sec * 1000 + opts.sample_period.it_value.tv_nsec / 1000000);
+    }
     // init timerfd
     tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
     if (tfd == -1)
@@ -791,18 +1120,120 @@ int main(int argc, char *const *argv)
         (void)close(tfd);
         return -1;
     }
+    // the wakeup jitter is what the real-time mode is meant to improve
+    if (opts.rt.enabled)
+    {
+        opts.jitter.enabled = 1;
+    }
+    rt_jitter_start(&opts.jitter, &opts.sample_period);
+    // data_file_out is a JSON output, next to the ones of the output lines
+    if (opts.data_file_out[0] != '\0')
+    {
+        if (output_add_dest(&opts.out, "json", opts.data_file_out) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Invalid data output: %s", opts.data_file_out);
+        }
+    }
+    // keep the regular output files open across samples,
+    // a missing reader on a name pipe is not fatal, the sink retries on the next batch
+    (void)output_open(&opts.out, &opts.fsink);
+    if (opts.aggregator_mode)
+    {
+        // merge the agent streams instead of sampling this host
+        ret = aggregator_run(&opts.agg, &opts.sample_period, &running);
+        aggregator_release(&opts.agg);
+        output_close(&opts.out);
+        alert_release(&opts.alert);
+        anomaly_release(&opts.anomaly);
+        (void)close(tfd);
+        return ret;
+    }
     //init CPU monitors
     opts.cpus = (sys_cpu_t *)malloc(opts.n_cpus * sizeof(sys_cpu_t));
     for (int i = 0; i < opts.n_cpus; i++)
     {
-        opts.cpus[i].last_sum = 0;
-        opts.cpus[i].last_idle = 0;
-        opts.cpus[i].percent = 0.0;
+        (void)memset(&opts.cpus[i], 0, sizeof(sys_cpu_t));
+        opts.cpus[i].freq_fd = -1;
+        if (opts.cpu_freq && i > 0)
+        {
+            char path[MAX_BUF * 2];
+            (void)snprintf(path, sizeof(path), CPU_FREQ_PT, opts.root_dir, i - 1);
+            opts.cpus[i].freq_fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (opts.cpus[i].freq_fd < 0)
+            {
+                M_ERROR(MODULE_NAME, "Unable to open %s: %s", path, strerror(errno));
+            }
+        }
+    }
+    if (opts.perf_counters)
+    {
+        // falls back to the /proc based statistics only if the kernel refuses the counters
+        (void)perf_open(&opts.perf, opts.n_cpus - 1);
+    }
+    if (opts.power.enabled && power_open(&opts.power, opts.root_dir) == -1)
+    {
+        M_ERROR(MODULE_NAME, "No readable powercap energy counter");
+    }
+    if ((opts.sched.schedstat || opts.sched.softirqs || opts.sched.irq_top) && sched_open(&opts.sched, opts.root_dir) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Scheduler and interrupt statistics are not available");
+    }
+    if (opts.numa.enabled && numa_open(&opts.numa, opts.root_dir) == -1)
+    {
+        M_ERROR(MODULE_NAME, "NUMA statistics are not available");
+    }
+    if (opts.sockstat.enabled && sockstat_open(&opts.sockstat, opts.root_dir) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Socket statistics are not available");
+    }
+    if (opts.vmstat.enabled && vmstat_open(&opts.vmstat, opts.root_dir) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Paging and reclaim statistics are not available");
+    }
+    if (opts.bat_stat.bat_in[0] != '\0' && opts.batsample.rate > 0)
+    {
+        opts.batsample.ratio = opts.bat_stat.ratio;
+        opts.batsample.min_voltage = opts.bat_stat.min_voltage;
+        opts.batsample.max_voltage = opts.bat_stat.max_voltage;
+        opts.batsample.empty_percent = opts.power_off_percent;
+        if (batsample_open(&opts.batsample, opts.bat_stat.bat_in) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Battery sampler disabled, one reading per sample");
+        }
+    }
+    if (opts.subscribe.path[0] != '\0' && subscribe_open(&opts.subscribe) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Subscriptions are disabled");
+    }
+    if (opts.history.dir[0] != '\0' && history_open(&opts.history, METRIC_COUNT) == -1)
+    {
+        M_ERROR(MODULE_NAME, "History segments are disabled");
+    }
+    if (opts.subsample.period_ms > 0)
+    {
+        char path[MAX_BUF * 2];
+        char tx_path[MAX_BUF * 2];
+        (void)snprintf(path, sizeof(path), "%s/proc/stat", opts.root_dir);
+        if (subsample_open(&opts.subsample, path) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Sub-sampling disabled");
+            subsample_close(&opts.subsample);
+        }
+        for (int i = 0; opts.subsample.tfd >= 0 && i < opts.net.n_intf; i++)
+        {
+            (void)snprintf(path, sizeof(path), NET_INF_STAT_PT, opts.root_dir, opts.net.interfaces[i].name, "rx_bytes");
+            (void)snprintf(tx_path, sizeof(tx_path), NET_INF_STAT_PT, opts.root_dir, opts.net.interfaces[i].name, "tx_bytes");
+            (void)subsample_add_net(&opts.subsample, path, tx_path);
+        }
     }
     // loop
-    count_down = opts.pwoff_cd;
     while (running)
     {
+        // one batch for all the sources, the collectors below only parse
+        if (opts.uring.fd >= 0 && uring_read(&opts.uring) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to submit batched reads: %s", strerror(errno));
+        }
         if (opts.bat_stat.bat_in[0] != '\0')
         {
             // open the file
@@ -815,39 +1246,41 @@ int main(int argc, char *const *argv)
             {
                 M_LOG(MODULE_NAME, "Invalid voltage read: %.3f", volt);
             }
-            else
-            {
-                if (opts.bat_stat.percent <= (float)opts.power_off_percent)
-                {
-                    count_down--;
-                    M_LOG(MODULE_NAME, "Out of battery. Will shutdown after %d count down", count_down);
-                }
-                else
-                {
-                    // reset the count_down
-                    count_down = opts.pwoff_cd;
-                }
-                // check if we should shutdown
-                if (count_down <= 0)
-                {
-                    M_LOG(MODULE_NAME, "Shutting down system");
-                    ret = system("poweroff");
-                    (void)ret;
-                    // this should never happend
-                    return 0;
-                }
-            }
         }
         // read cpu info
         if (read_cpu_info(&opts) == -1)
         {
             M_ERROR(MODULE_NAME, "Unable to read CPU infos");
         }
+        if (read_cpu_freq(&opts) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read CPU frequency");
+        }
+        if (perf_read(&opts.perf) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read perf counters");
+        }
+        if (power_read(&opts.power) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read powercap energy");
+        }
+        if (sched_read(&opts.sched) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read scheduler statistics");
+        }
         // read memory usage
         if (read_mem_info(&opts) == -1)
         {
             M_ERROR(MODULE_NAME, "Unable to read memory usage");
         }
+        if (numa_read(&opts.numa) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read NUMA statistics");
+        }
+        if (vmstat_read(&opts.vmstat) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to read paging and reclaim statistics");
+        }
         // read CPU temperature
         if (read_cpu_temp(&opts) == -1)
         {
@@ -857,28 +1290,112 @@ int main(int argc, char *const *argv)
         {
             M_ERROR(MODULE_NAME, "Unable to query network statistic");
         }
+        if (sockstat_read(&opts.sockstat) == -1)
+        {
+            M_ERROR(MODULE_NAME, "Unable to query socket statistics");
+        }
         if (read_disk_usage(&opts) == -1)
         {
             M_ERROR(MODULE_NAME, "Unable to query disk usage");
         }
-        // log to file
-        if (log_to_file(&opts) == -1)
+        // evaluate alert rules before the record is written, so events precede it
+        collect_metrics(&opts);
+        alert_eval(&opts.alert, opts.metrics);
+        adaptive_in[ADAPTIVE_CPU] = opts.metrics[METRIC_CPU_USAGE];
+        adaptive_in[ADAPTIVE_NET] = opts.metrics[METRIC_NET_RX_RATE] + opts.metrics[METRIC_NET_TX_RATE];
+        adaptive_in[ADAPTIVE_TEMP] = opts.metrics[METRIC_CPU_TEMP];
+        new_period = adaptive_update(&opts.adaptive, adaptive_in);
+        gettimeofday(&now, NULL);
+        // subscribers get the metric vector directly, encoded per client
+        if (opts.subscribe.listen_fd >= 0)
+        {
+            subscribe_poll(&opts.subscribe);
+            subscribe_publish(&opts.subscribe, opts.metrics, METRIC_COUNT, (int64_t)now.tv_sec * 1000000 + now.tv_usec);
+        }
+        if (history_append(&opts.history, (int64_t)now.tv_sec * 1000000 + now.tv_usec, opts.metrics) == -1)
         {
-            M_ERROR(MODULE_NAME, "Unable to write sysinfo to output");
+            M_ERROR(MODULE_NAME, "Unable to write history segment");
         }
+        // anomaly events precede the record that flags them
+        anomaly_eval(&opts.anomaly, opts.metrics, &now);
+        // log to file
+        log_to_file(&opts);
+        subsample_reset(&opts.subsample);
         // check timeout
+        if (opts.subsample.tfd >= 0)
+        {
+            (void)subsample_wait(&opts.subsample, tfd);
+        }
         if (read(tfd, &expirations_count, sizeof(expirations_count)) != (int)sizeof(expirations_count))
         {
             M_ERROR(MODULE_NAME, "Unable to read timer: %s", strerror(errno));
         }
-        else if (expirations_count > 1u)
+        else
+        {
+            rt_jitter_update(&opts.jitter, expirations_count);
+            if (expirations_count > 1u)
+            {
+                M_ERROR(MODULE_NAME, "LOOP OVERFLOW COUNT: %lu", (long unsigned int)expirations_count);
+            }
+        }
+        if (first && opts.uring.enabled)
         {
-            M_ERROR(MODULE_NAME, "LOOP OVERFLOW COUNT: %lu", (long unsigned int)expirations_count);
+            setup_batch_reads(&opts);
+        }
+        first = 0;
+        if (opts.rt.enabled && !rt_active)
+        {
+            freeze_buffers(&opts);
+            (void)rt_enter(&opts.rt);
+            rt_active = 1;
+        }
+        if (new_period != 0)
+        {
+            // re-arm after the pending expiration was consumed, the next sample comes one new period later
+            set_period(&opts.sample_period, new_period);
+            if (timerfd_settime(tfd, 0, &opts.sample_period, NULL) == -1)
+            {
+                M_ERROR(MODULE_NAME, "Unable to set sample period to %u ms: %s", new_period, strerror(errno));
+            }
+            rt_jitter_rebase(&opts.jitter, &opts.sample_period);
         }
     }
+    rt_jitter_log(&opts.jitter);
+    subsample_close(&opts.subsample);
+    uring_release(&opts.uring);
+    power_close(&opts.power);
+    sched_close(&opts.sched);
+    numa_close(&opts.numa);
+    sockstat_close(&opts.sockstat);
+    vmstat_close(&opts.vmstat);
+    subscribe_close(&opts.subscribe);
+    history_close(&opts.history);
+    M_LOG(MODULE_NAME, "Average wakeups per minute: %.1f", adaptive_wakeups_per_min(&opts.adaptive));
 
+    output_close(&opts.out);
+    alert_release(&opts.alert);
+    anomaly_release(&opts.anomaly);
+    perf_close(&opts.perf);
+    pfile_close(&opts.stat);
+    pfile_close(&opts.meminfo);
+    batsample_close(&opts.batsample);
+    pfile_close(&opts.bat_stat.file);
+    pfile_close(&opts.temp.cpu_file);
+    pfile_close(&opts.temp.gpu_file);
+    for (int i = 0; i < opts.net.n_intf; i++)
+    {
+        pfile_close(&opts.net.interfaces[i].rx_file);
+        pfile_close(&opts.net.interfaces[i].tx_file);
+    }
     if (opts.cpus)
+    {
+        for (int i = 0; i < opts.n_cpus; i++)
+        {
+            if (opts.cpus[i].freq_fd >= 0)
+                (void)close(opts.cpus[i].freq_fd);
+        }
         free(opts.cpus);
+    }
     if (tfd > 0)
     {
         (void)close(tfd);
@@ -0,0 +1,27 @@
+#ifndef SYSMON_H
+#define SYSMON_H
+
+#include <stddef.h>
+#include <syslog.h>
+
+#define MODULE_NAME "sysmon"
+
+#define LOG_INIT(m)                                              \
+    do                                                           \
+    {                                                            \
+        setlogmask(LOG_UPTO(LOG_NOTICE));                        \
+        openlog((m), LOG_CONS | LOG_PID | LOG_NDELAY, LOG_USER); \
+    } while (0)
+
+#define M_LOG(m, a, ...) syslog((LOG_NOTICE), m "_log@[%s: %d]: " a "\n", __FILE__, \
+                                __LINE__, ##__VA_ARGS__)
+
+#define M_ERROR(m, a, ...) syslog((LOG_ERR), m "_error@[%s: %d]: " a "\n", __FILE__, \
+                                  __LINE__, ##__VA_ARGS__)
+
+#define MAX_BUF 256
+#define EQU(a, b) (strncmp(a, b, MAX_BUF) == 0)
+
+int guard_write(int fd, void *buffer, size_t size);
+
+#endif
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""
+Battery fixture for the oversampling thread: rewrites battery_input in
+place (the descriptor of sysmond stays open) about every millisecond with
+a discharging voltage, gaussian noise, spikes and periodic load sags.
+
+usage: batfixture.py <path> [options], then run sysmond with
+    battery_input = <path>
+    battery_sample_rate = 200
+--fail-after empties the file: every later reading fails, and the daemon
+must report the voltage as unreadable instead of keeping the last value.
+"""
+import argparse
+import os
+import random
+import time
+
+
+def main():
+    parser = argparse.ArgumentParser(description="battery_input fixture")
+    parser.add_argument("path")
+    parser.add_argument("--duration", type=float, default=60.0, help="seconds to run")
+    parser.add_argument("--start", type=float, default=3950.0, help="initial reading")
+    parser.add_argument("--slope", type=float, default=-2.0, help="drift per second")
+    parser.add_argument("--noise", type=float, default=15.0, help="standard deviation")
+    parser.add_argument("--spikes", type=float, default=0.05, help="share of +/-400 spikes")
+    parser.add_argument("--sag", type=float, default=150.0, help="load sag, 300 ms every 3 s")
+    parser.add_argument("--fail-after", type=float, default=0.0, help="empty the file after that many seconds")
+    args = parser.parse_args()
+
+    fd = os.open(args.path, os.O_WRONLY | os.O_CREAT, 0o644)
+    t0 = time.time()
+    try:
+        while True:
+            t = time.time() - t0
+            if t >= args.duration:
+                break
+            if args.fail_after > 0 and t >= args.fail_after:
+                os.ftruncate(fd, 0)
+                time.sleep(min(0.1, args.duration - t))
+                continue
+            v = args.start + args.slope * t + random.gauss(0, args.noise)
+            if t % 3 < 0.3:
+                v -= args.sag
+            if random.random() < args.spikes:
+                v += random.choice((-400, 400))
+            # fixed width: a shorter value never leaves digits of the previous one
+            os.pwrite(fd, (b"%d\n" % int(v)).ljust(8), 0)
+            time.sleep(0.001)
+    finally:
+        os.close(fd)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,240 @@
+/**
+ * Microbenchmark of the record encoder: the CPU usage and network lists
+ * of a 256 CPU / 64 interface host, encoded with the former snprintf/strlen
+ * chain and with obuf. Both outputs must be byte identical.
+ *
+ * usage: encode_bench [root_dir [iterations]]
+ * without root_dir, a fixture tree is generated in a temporary directory
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+
+#include "obuf.h"
+#include "fixture.h"
+
+#define BENCH_CPUS 256
+#define BENCH_INTFS 64
+#define BENCH_MAX_CPUS 1024
+#define BENCH_MAX_INTFS 256
+
+#define JSON_NET_FMT "{"                  \
+                     "\"name\":\"%s\","   \
+                     "\"rx\": %lu,"       \
+                     "\"tx\": %lu,"       \
+                     "\"rx_rate\": %.3f," \
+                     "\"tx_rate\": %.3f"  \
+                     "},"
+
+typedef struct
+{
+    char name[64];
+    unsigned long rx;
+    unsigned long tx;
+    float rx_rate;
+    float tx_rate;
+} bench_intf_t;
+
+static float cpus[BENCH_MAX_CPUS];
+static int n_cpus;
+static bench_intf_t intfs[BENCH_MAX_INTFS];
+static int n_intfs;
+
+static unsigned long read_counter(const char *root, const char *intf, const char *name)
+{
+    char path[512];
+    unsigned long value = 0;
+    FILE *fp;
+    (void)snprintf(path, sizeof(path), "%s/sys/class/net/%s/statistics/%s", root, intf, name);
+    fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+    if (fscanf(fp, "%lu", &value) != 1)
+        value = 0;
+    (void)fclose(fp);
+    return value;
+}
+
+/*per CPU usage from a single /proc/stat snapshot, interfaces from /sys/class/net*/
+static int load_fixture(const char *root)
+{
+    char path[512], line[512];
+    unsigned long long v[10], total, idle;
+    struct dirent *ent;
+    DIR *dir;
+    FILE *fp;
+    (void)snprintf(path, sizeof(path), "%s/proc/stat", root);
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    n_cpus = 0;
+    while (fgets(line, sizeof(line), fp) && n_cpus < BENCH_MAX_CPUS)
+    {
+        if (strncmp(line, "cpu", 3) != 0)
+            break;
+        (void)memset(v, 0, sizeof(v));
+        if (sscanf(line, "%*s %llu %llu %llu %llu %llu %llu %llu %llu", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+                   &v[6], &v[7]) < 4)
+            continue;
+        total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+        idle = v[3] + v[4];
+        cpus[n_cpus++] = total > 0 ? (float)(100.0 * (total - idle) / total) : 0.0f;
+    }
+    (void)fclose(fp);
+    (void)snprintf(path, sizeof(path), "%s/sys/class/net", root);
+    dir = opendir(path);
+    if (!dir)
+        return -1;
+    n_intfs = 0;
+    while ((ent = readdir(dir)) != NULL && n_intfs < BENCH_MAX_INTFS)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        bench_intf_t *intf = &intfs[n_intfs++];
+        (void)snprintf(intf->name, sizeof(intf->name), "%s", ent->d_name);
+        intf->rx = read_counter(root, ent->d_name, "rx_bytes");
+        intf->tx = read_counter(root, ent->d_name, "tx_bytes");
+        intf->rx_rate = (float)(intf->rx % 100000) / 7.0f;
+        intf->tx_rate = (float)(intf->tx % 100000) / 3.0f;
+    }
+    (void)closedir(dir);
+    return n_cpus > 0 ? 0 : -1;
+}
+
+/*the former log_to_file loops, with buffers large enough not to truncate*/
+static size_t encode_legacy(char *out, size_t size, char *buf, char *net_buf, size_t lsize)
+{
+    char *ptr;
+    size_t len = 0;
+    (void)memset(out, 0, size);
+    (void)memset(buf, 0, lsize);
+    (void)memset(net_buf, 0, lsize);
+    ptr = buf;
+    for (int i = 0; i < n_cpus; i++)
+    {
+        snprintf(ptr, lsize - len - 1, "%.3f,", cpus[i]);
+        len = strlen(buf);
+        ptr = buf + len;
+    }
+    if (len > 0)
+        buf[len - 1] = '\0';
+    len = 0;
+    ptr = net_buf;
+    for (int i = 0; i < n_intfs; i++)
+    {
+        snprintf(ptr, lsize - len - 1, JSON_NET_FMT, intfs[i].name, intfs[i].rx, intfs[i].tx, intfs[i].rx_rate,
+                 intfs[i].tx_rate);
+        len = strlen(net_buf);
+        ptr = net_buf + len;
+    }
+    if (len > 0)
+        net_buf[len - 1] = '\0';
+    snprintf(out, size, "\"cpu_usages\":[%s],\"net\":[%s]", buf, net_buf);
+    out[strlen(out)] = '\n';
+    return strlen(out);
+}
+
+static void encode_obuf(obuf_t *ob)
+{
+    obuf_reset(ob);
+    OBUF_LIT(ob, "\"cpu_usages\":[");
+    for (int i = 0; i < n_cpus; i++)
+    {
+        if (i > 0)
+            obuf_putc(ob, ',');
+        obuf_fixed(ob, cpus[i], 3);
+    }
+    OBUF_LIT(ob, "],\"net\":[");
+    for (int i = 0; i < n_intfs; i++)
+    {
+        if (i > 0)
+            obuf_putc(ob, ',');
+        OBUF_LIT(ob, "{\"name\":\"");
+        obuf_puts(ob, intfs[i].name);
+        OBUF_LIT(ob, "\",\"rx\": ");
+        obuf_u64(ob, intfs[i].rx);
+        OBUF_LIT(ob, ",\"tx\": ");
+        obuf_u64(ob, intfs[i].tx);
+        OBUF_LIT(ob, ",\"rx_rate\": ");
+        obuf_fixed(ob, intfs[i].rx_rate, 3);
+        OBUF_LIT(ob, ",\"tx_rate\": ");
+        obuf_fixed(ob, intfs[i].tx_rate, 3);
+        obuf_putc(ob, '}');
+    }
+    OBUF_LIT(ob, "]\n");
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    char tmp[] = "/tmp/encode_bench.XXXXXX";
+    const char *root;
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+    size_t lsize = 1 << 20, legacy_len = 0;
+    char *out, *buf, *net_buf;
+    double t0, legacy_ns, obuf_ns;
+    obuf_t ob;
+    int ret = 0;
+    if (argc > 1)
+    {
+        root = argv[1];
+    }
+    else
+    {
+        root = mkdtemp(tmp);
+        if (!root || fixture_make(root, BENCH_CPUS, BENCH_INTFS) == -1)
+        {
+            fprintf(stderr, "Unable to create the fixture tree\n");
+            return 1;
+        }
+    }
+    if (load_fixture(root) == -1)
+    {
+        fprintf(stderr, "Unable to load the fixture tree %s\n", root);
+        ret = 1;
+        goto end;
+    }
+    out = malloc(lsize);
+    buf = malloc(lsize);
+    net_buf = malloc(lsize);
+    if (!out || !buf || !net_buf)
+    {
+        ret = 1;
+        goto end;
+    }
+    obuf_init(&ob);
+    t0 = now_ns();
+    for (int i = 0; i < iterations; i++)
+        legacy_len = encode_legacy(out, lsize, buf, net_buf, lsize);
+    legacy_ns = (now_ns() - t0) / iterations;
+    t0 = now_ns();
+    for (int i = 0; i < iterations; i++)
+        encode_obuf(&ob);
+    obuf_ns = (now_ns() - t0) / iterations;
+    printf("%d CPUs, %d interfaces, %zu bytes per record\n", n_cpus, n_intfs, ob.len);
+    printf("snprintf/strlen: %10.0f ns/record\n", legacy_ns);
+    printf("obuf:            %10.0f ns/record (x%.1f)\n", obuf_ns, obuf_ns > 0 ? legacy_ns / obuf_ns : 0.0);
+    if (ob.error || ob.len != legacy_len || memcmp(ob.data, out, legacy_len) != 0)
+    {
+        fprintf(stderr, "Encoded records differ\n");
+        ret = 1;
+    }
+    obuf_free(&ob);
+    free(out);
+    free(buf);
+    free(net_buf);
+end:
+    if (argc <= 1)
+        fixture_remove(root);
+    return ret;
+}
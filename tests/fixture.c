@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "fixture.h"
+
+int fixture_write(const char *path, const char *data)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    (void)fputs(data, fp);
+    return fclose(fp);
+}
+
+int fixture_stat(const char *root, int n_cpus)
+{
+    char path[512];
+    FILE *fp;
+    (void)snprintf(path, sizeof(path), "%s/proc/stat", root);
+    // rewritten in place, a file kept open sees the new content
+    fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    fprintf(fp, "cpu  %d 0 %d %d 0 0 0 0 0 0\n", n_cpus * 1000, n_cpus * 200, n_cpus * 5000);
+    for (int i = 0; i < n_cpus; i++)
+        fprintf(fp, "cpu%d %d 17 %d %d 12 0 3 0 0 0\n", i, 1000 + i * 37, 200 + i, 5000 + i * 11);
+    fprintf(fp, "intr 123456789 0 9 0 0\nctxt 987654321\nbtime 1700000000\nprocesses 4242\n");
+    return fclose(fp);
+}
+
+int fixture_make(const char *root, int n_cpus, int n_intfs)
+{
+    char path[512], line[256];
+    (void)snprintf(path, sizeof(path), "%s/proc", root);
+    (void)mkdir(path, 0755);
+    if (fixture_stat(root, n_cpus) == -1)
+        return -1;
+    (void)snprintf(path, sizeof(path), "%s/proc/meminfo", root);
+    if (fixture_write(path, "MemTotal:       16303428 kB\nMemFree:         8123456 kB\n"
+                            "MemAvailable:   12345678 kB\nBuffers:          234567 kB\nCached:          3456789 kB\n"
+                            "SwapTotal:       2097148 kB\nSwapFree:        2097148 kB\n") == -1)
+        return -1;
+    (void)snprintf(path, sizeof(path), "%s/sys", root);
+    (void)mkdir(path, 0755);
+    (void)snprintf(path, sizeof(path), "%s/sys/class", root);
+    (void)mkdir(path, 0755);
+    (void)snprintf(path, sizeof(path), "%s/sys/class/net", root);
+    (void)mkdir(path, 0755);
+    for (int i = 0; i < n_intfs; i++)
+    {
+        (void)snprintf(path, sizeof(path), "%s/sys/class/net/eth%d", root, i);
+        (void)mkdir(path, 0755);
+        (void)snprintf(path, sizeof(path), "%s/sys/class/net/eth%d/statistics", root, i);
+        (void)mkdir(path, 0755);
+        (void)snprintf(path, sizeof(path), "%s/sys/class/net/eth%d/statistics/rx_bytes", root, i);
+        (void)snprintf(line, sizeof(line), "%llu\n", 123456789ULL * (i + 1));
+        if (fixture_write(path, line) == -1)
+            return -1;
+        (void)snprintf(path, sizeof(path), "%s/sys/class/net/eth%d/statistics/tx_bytes", root, i);
+        (void)snprintf(line, sizeof(line), "%llu\n", 98765432ULL * (i + 3));
+        if (fixture_write(path, line) == -1)
+            return -1;
+    }
+    return 0;
+}
+
+void fixture_remove(const char *root)
+{
+    char cmd[600];
+    (void)snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    (void)system(cmd);
+}
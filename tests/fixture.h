@@ -0,0 +1,14 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+/**
+ * Fixture tree of the check programs: a root_dir with /proc/stat,
+ * /proc/meminfo and the counters of /sys/class/net, as sysmond reads them
+ */
+int fixture_write(const char *path, const char *data);
+/*(re)write <root>/proc/stat with n_cpus CPU lines*/
+int fixture_stat(const char *root, int n_cpus);
+int fixture_make(const char *root, int n_cpus, int n_intfs);
+void fixture_remove(const char *root);
+
+#endif
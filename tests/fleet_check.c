@@ -0,0 +1,166 @@
+/**
+ * End to end check of the aggregator mode: N agents, each sampling its own
+ * fixture tree (root_dir), stream their records to one aggregator over a
+ * unix socket. Every host must appear, not stale, in the fleet record.
+ *
+ * usage: fleet_check [sysmond [agents]]
+ * sysmond defaults to ./sysmond in the build directory.
+ * Exits with 77 (skipped) when the daemon binary is not there
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "fixture.h"
+
+#define FLEET_MAX_AGENTS 32
+#define FLEET_TIMEOUT_MS 10000
+
+static pid_t pids[FLEET_MAX_AGENTS + 1];
+static int n_pids;
+
+static pid_t start(const char *sysmond, const char *conf)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        execl(sysmond, sysmond, "-f", conf, (char *)NULL);
+        _exit(127);
+    }
+    if (pid > 0)
+        pids[n_pids++] = pid;
+    return pid;
+}
+
+static void stop_all(void)
+{
+    for (int i = 0; i < n_pids; i++)
+        (void)kill(pids[i], SIGTERM);
+    for (int i = 0; i < n_pids; i++)
+        (void)waitpid(pids[i], NULL, 0);
+    n_pids = 0;
+}
+
+static void sleep_ms(int ms)
+{
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    (void)nanosleep(&ts, NULL);
+}
+
+/*last complete line of the fleet output, NULL when there is none yet*/
+static char *last_record(const char *path)
+{
+    static char line[1 << 16];
+    char buf[sizeof(line)];
+    int found = 0;
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return NULL;
+    while (fgets(buf, sizeof(buf), fp))
+    {
+        size_t len = strlen(buf);
+        if (len > 0 && buf[len - 1] == '\n')
+        {
+            (void)memcpy(line, buf, len + 1);
+            found = 1;
+        }
+    }
+    (void)fclose(fp);
+    return found ? line : NULL;
+}
+
+/*return the number of agents listed and fresh in record*/
+static int count_hosts(const char *record, int n_agents)
+{
+    char pattern[64];
+    const char *ptr;
+    int n = 0;
+    for (int i = 0; i < n_agents; i++)
+    {
+        (void)snprintf(pattern, sizeof(pattern), "{\"host\":\"fleet-%d\",", i);
+        ptr = strstr(record, pattern);
+        if (ptr && (ptr = strstr(ptr, "\"stale\": ")) != NULL && ptr[9] == '0')
+            n++;
+    }
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    char tmp[] = "/tmp/fleet_check.XXXXXX";
+    char path[256], conf[1024], sock[256], out[256];
+    const char *sysmond = argc > 1 ? argv[1] : "./sysmond";
+    int n_agents = argc > 2 ? atoi(argv[2]) : 8;
+    char *record = NULL;
+    struct stat st;
+    int ret = 1, n = 0;
+    if (access(sysmond, X_OK) != 0)
+    {
+        printf("%s not found, skipped\n", sysmond);
+        return 77;
+    }
+    if (n_agents < 1 || n_agents > FLEET_MAX_AGENTS)
+        n_agents = 8;
+    if (!mkdtemp(tmp))
+    {
+        fprintf(stderr, "Unable to create the fixture directory\n");
+        return 1;
+    }
+    (void)snprintf(sock, sizeof(sock), "%s/agg.sock", tmp);
+    (void)snprintf(out, sizeof(out), "%s/fleet.json", tmp);
+    (void)snprintf(path, sizeof(path), "%s/agg.conf", tmp);
+    (void)snprintf(conf, sizeof(conf),
+                   "mode = aggregator\nsample_period = 200\ndata_file_out = %s\n"
+                   "aggregator_listen = unix:%s\naggregator_stale_ms = 2000\n",
+                   out, sock);
+    if (fixture_write(path, conf) == -1 || start(sysmond, path) == -1)
+        goto end;
+    for (int ms = 0; stat(sock, &st) != 0; ms += 50)
+    {
+        if (ms >= FLEET_TIMEOUT_MS)
+        {
+            fprintf(stderr, "The aggregator did not listen on %s\n", sock);
+            goto end;
+        }
+        sleep_ms(50);
+    }
+    for (int i = 0; i < n_agents; i++)
+    {
+        char root[256];
+        (void)snprintf(root, sizeof(root), "%s/host%d", tmp, i);
+        if (mkdir(root, 0755) == -1 || fixture_make(root, 2, 1) == -1)
+        {
+            fprintf(stderr, "Unable to create the fixture tree %s\n", root);
+            goto end;
+        }
+        (void)snprintf(path, sizeof(path), "%s/agent%d.conf", tmp, i);
+        (void)snprintf(conf, sizeof(conf),
+                       "sample_period = 200\ncpu_core_number = 2\nroot_dir = %s\nnetwork_interfaces = eth0\n"
+                       "host_name = fleet-%d\ndata_file_out = sock:%s\n",
+                       root, i, sock);
+        if (fixture_write(path, conf) == -1 || start(sysmond, path) == -1)
+            goto end;
+    }
+    for (int ms = 0; ms < FLEET_TIMEOUT_MS; ms += 100)
+    {
+        sleep_ms(100);
+        record = last_record(out);
+        if (record && (n = count_hosts(record, n_agents)) == n_agents)
+        {
+            ret = 0;
+            break;
+        }
+    }
+    printf("%d/%d agents in the fleet record\n", n, n_agents);
+    if (ret != 0 && record)
+        fprintf(stderr, "Last fleet record: %.512s\n", record);
+end:
+    stop_all();
+    fixture_remove(tmp);
+    return ret;
+}
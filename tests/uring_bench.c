@@ -0,0 +1,222 @@
+/**
+ * Measurement harness of the io_uring backend: the sources of a 256 CPU /
+ * 64 interface host are read once per sample with pread, then as one
+ * io_uring batch. Both must return the same content, including after
+ * /proc/stat outgrew its registered buffer. The time and the system
+ * calls (pread, io_uring_enter/register) per sample are reported.
+ *
+ * usage: uring_bench [root_dir [iterations]]
+ * without root_dir, a fixture tree is generated in a temporary directory.
+ * Exits with 77 (skipped) when io_uring is not usable here
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+
+#include "pfile.h"
+#include "uring.h"
+#include "fixture.h"
+
+#define BENCH_CPUS 256
+#define BENCH_INTFS 64
+/*lines of /proc/stat read by the first sample of sysmond (cpu_core_number = 4)*/
+#define BENCH_STAT_LINES 5
+
+static pfile_t files[URING_MAX_FILES];
+static char *paths[URING_MAX_FILES];
+static char *expected[URING_MAX_FILES];
+static int n_files;
+
+static void add_file(const char *path)
+{
+    if (n_files >= URING_MAX_FILES)
+        return;
+    pfile_init(&files[n_files]);
+    if (pfile_open(&files[n_files], path) == 0 && (paths[n_files] = strdup(path)) != NULL)
+        n_files++;
+}
+
+static int open_sources(const char *root)
+{
+    char path[512];
+    struct dirent *ent;
+    DIR *dir;
+    (void)snprintf(path, sizeof(path), "%s/proc/stat", root);
+    add_file(path);
+    (void)snprintf(path, sizeof(path), "%s/proc/meminfo", root);
+    add_file(path);
+    (void)snprintf(path, sizeof(path), "%s/sys/class/net", root);
+    dir = opendir(path);
+    if (!dir)
+        return -1;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        (void)snprintf(path, sizeof(path), "%s/sys/class/net/%s/statistics/rx_bytes", root, ent->d_name);
+        add_file(path);
+        (void)snprintf(path, sizeof(path), "%s/sys/class/net/%s/statistics/tx_bytes", root, ent->d_name);
+        add_file(path);
+    }
+    (void)closedir(dir);
+    return n_files > 0 ? 0 : -1;
+}
+
+/*the reference content of every source, read apart from the registered buffers*/
+static int snapshot(void)
+{
+    FILE *fp;
+    long size;
+    for (int i = 0; i < n_files; i++)
+    {
+        free(expected[i]);
+        expected[i] = NULL;
+        fp = fopen(paths[i], "r");
+        if (!fp)
+            return -1;
+        (void)fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        rewind(fp);
+        expected[i] = (char *)calloc(1, (size_t)size + 1);
+        if (!expected[i] || fread(expected[i], 1, (size_t)size, fp) != (size_t)size)
+        {
+            (void)fclose(fp);
+            return -1;
+        }
+        (void)fclose(fp);
+    }
+    return 0;
+}
+
+/*one batch, then the content seen by the collectors*/
+static int check_batch(uring_t *ring)
+{
+    if (uring_read(ring) == -1)
+        return -1;
+    for (int i = 0; i < n_files; i++)
+    {
+        if (pfile_read(&files[i], 0) < 0 || strcmp(files[i].data, expected[i]) != 0)
+        {
+            fprintf(stderr, "Source %d differs after the io_uring batch (%zu bytes read)\n", i, files[i].len);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*pread calls of all the sources so far*/
+static uint64_t preads(void)
+{
+    uint64_t n = 0;
+    for (int i = 0; i < n_files; i++)
+        n += files[i].reads;
+    return n;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    char tmp[] = "/tmp/uring_bench.XXXXXX";
+    const char *root;
+    int iterations = argc > 2 ? atoi(argv[2]) : 2000;
+    double t0, pread_ns, uring_ns, pread_calls, uring_calls;
+    uint64_t c0, s0;
+    uring_t ring;
+    int ret = 0;
+    if (argc > 1)
+    {
+        root = argv[1];
+    }
+    else
+    {
+        root = mkdtemp(tmp);
+        if (!root || fixture_make(root, BENCH_CPUS, BENCH_INTFS) == -1)
+        {
+            fprintf(stderr, "Unable to create the fixture tree\n");
+            return 1;
+        }
+    }
+    if (open_sources(root) == -1)
+    {
+        fprintf(stderr, "Unable to open the sources of %s\n", root);
+        ret = 1;
+        goto end;
+    }
+    // as in the daemon, the first sample only read the head of /proc/stat
+    (void)pfile_read(&files[0], BENCH_STAT_LINES);
+    uring_init(&ring);
+    ring.enabled = 1;
+    for (int i = 0; i < n_files; i++)
+        (void)uring_add(&ring, &files[i]);
+    if (uring_setup(&ring) == -1)
+    {
+        printf("io_uring unavailable, skipped\n");
+        ret = 77;
+        goto end;
+    }
+    if (snapshot() == -1 || check_batch(&ring) == -1)
+    {
+        ret = 1;
+        goto release;
+    }
+    c0 = preads();
+    t0 = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        for (int j = 0; j < n_files; j++)
+            (void)pfile_read(&files[j], 0);
+    }
+    pread_ns = (now_ns() - t0) / iterations;
+    pread_calls = (double)(preads() - c0) / iterations;
+    // the sources that fell back to pread count with the ring calls
+    c0 = preads();
+    s0 = ring.syscalls;
+    t0 = now_ns();
+    for (int i = 0; i < iterations; i++)
+    {
+        (void)uring_read(&ring);
+        for (int j = 0; j < n_files; j++)
+            (void)pfile_read(&files[j], 0);
+    }
+    uring_ns = (now_ns() - t0) / iterations;
+    uring_calls = (double)(preads() - c0 + ring.syscalls - s0) / iterations;
+    printf("%d sources, %zu bytes of /proc/stat\n", n_files, files[0].len);
+    printf("pread:    %10.0f ns/sample, %7.1f syscalls/sample\n", pread_ns, pread_calls);
+    printf("io_uring: %10.0f ns/sample, %7.1f syscalls/sample (x%.1f), %lu regrows\n", uring_ns, uring_calls,
+           uring_ns > 0 ? pread_ns / uring_ns : 0.0, (unsigned long)ring.regrows);
+    // more CPUs online: /proc/stat no longer fits its registered buffer
+    if (argc <= 1)
+    {
+        if (fixture_stat(root, BENCH_CPUS * 4) == -1 || snapshot() == -1 || check_batch(&ring) == -1 ||
+            check_batch(&ring) == -1 || ring.regrows != 1)
+        {
+            fprintf(stderr, "/proc/stat was not regrown (%lu regrows)\n", (unsigned long)ring.regrows);
+            ret = 1;
+        }
+        else
+        {
+            printf("/proc/stat regrown to %zu bytes, %lu regrows, %lu io_uring syscalls in all\n", files[0].cap,
+                   (unsigned long)ring.regrows, (unsigned long)ring.syscalls);
+        }
+    }
+release:
+    uring_release(&ring);
+end:
+    for (int i = 0; i < n_files; i++)
+    {
+        pfile_close(&files[i]);
+        free(paths[i]);
+        free(expected[i]);
+    }
+    if (argc <= 1)
+        fixture_remove(root);
+    return ret;
+}
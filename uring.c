@@ -0,0 +1,319 @@
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
+
+#include "sysmon.h"
+#include "uring.h"
+
+/*registered buffers are sized from a full read, with room to grow*/
+#define URING_BUF_ALIGN 256
+
+void uring_init(uring_t *ring)
+{
+    (void)memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+int uring_config(uring_t *ring, const char *name, const char *value)
+{
+    if (EQU(name, "io_uring"))
+    {
+        ring->enabled = atoi(value);
+        return 1;
+    }
+    return 0;
+}
+
+/*register an open source, before uring_setup*/
+int uring_add(uring_t *ring, pfile_t *pf)
+{
+    if (pf->fd < 0)
+        return 0;
+    if (ring->n_files >= URING_MAX_FILES)
+    {
+        M_ERROR(MODULE_NAME, "Too many io_uring sources, the extra ones use pread");
+        return -1;
+    }
+    ring->files[ring->n_files++] = pf;
+    return 0;
+}
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+static int uring_map(uring_t *ring, struct io_uring_params *params)
+{
+    ring->sq_ring_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+            ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = 0;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        return -1;
+    }
+    if (ring->cq_ring_size == 0)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            return -1;
+        }
+    }
+    ring->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        return -1;
+    }
+    ring->sq_head = (uint32_t *)((char *)ring->sq_ring + params->sq_off.head);
+    ring->sq_tail = (uint32_t *)((char *)ring->sq_ring + params->sq_off.tail);
+    ring->sq_mask = (uint32_t *)((char *)ring->sq_ring + params->sq_off.ring_mask);
+    ring->sq_array = (uint32_t *)((char *)ring->sq_ring + params->sq_off.array);
+    ring->cq_head = (uint32_t *)((char *)ring->cq_ring + params->cq_off.head);
+    ring->cq_tail = (uint32_t *)((char *)ring->cq_ring + params->cq_off.tail);
+    ring->cq_mask = (uint32_t *)((char *)ring->cq_ring + params->cq_off.ring_mask);
+    ring->cqes = (char *)ring->cq_ring + params->cq_off.cqes;
+    return 0;
+}
+
+/*twice the content of a full read, the buffer must not move once registered*/
+static int buf_size(pfile_t *pf)
+{
+    size_t size;
+    char *ptr;
+    pf->fixed = 0;
+    // the collectors may have stopped at max_lines, the batch reads whole files
+    if (pfile_read(pf, 0) < 0)
+        pf->len = 0;
+    size = (pf->len * 2 + URING_BUF_ALIGN) & ~((size_t)URING_BUF_ALIGN - 1);
+    if (size > pf->cap)
+    {
+        ptr = (char *)realloc(pf->data, size);
+        if (!ptr)
+            return -1;
+        pf->data = ptr;
+        pf->cap = size;
+    }
+    pf->fixed = 1;
+    return 0;
+}
+
+static int register_buffers(uring_t *ring)
+{
+    struct iovec iov[URING_MAX_FILES];
+    for (int i = 0; i < ring->n_files; i++)
+    {
+        iov[i].iov_base = ring->files[i]->data;
+        iov[i].iov_len = ring->files[i]->cap;
+    }
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, ring->n_files) < 0)
+        return -1;
+    return 0;
+}
+
+static int uring_register(uring_t *ring)
+{
+    int fds[URING_MAX_FILES];
+    for (int i = 0; i < ring->n_files; i++)
+    {
+        if (buf_size(ring->files[i]) == -1)
+            return -1;
+        fds[i] = ring->files[i]->fd;
+    }
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_FILES, fds, ring->n_files) < 0)
+        return -1;
+    return register_buffers(ring);
+}
+
+/**
+ * Sources that outgrew their buffer are read again with pread into a
+ * larger one, and the buffers are registered again. The fresh content
+ * is handed to the collectors of the current sample
+ */
+static int uring_regrow(uring_t *ring)
+{
+    pfile_t *pf;
+    ring->syscalls += 2;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0) < 0)
+        return -1;
+    for (int i = 0; i < ring->n_files; i++)
+    {
+        pf = ring->files[i];
+        if (!pf->truncated)
+            continue;
+        if (buf_size(pf) == -1)
+            return -1;
+        pf->ready = pf->len > 0;
+        ring->regrows++;
+    }
+    return register_buffers(ring);
+}
+
+/*create the ring and register the sources added so far, return -1 if io_uring is unusable*/
+int uring_setup(uring_t *ring)
+{
+    struct io_uring_params params;
+    if (!ring->enabled || ring->n_files == 0)
+        return -1;
+    (void)memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, (unsigned)ring->n_files, &params);
+    if (ring->fd < 0)
+    {
+        M_ERROR(MODULE_NAME, "io_uring unavailable, using pread: %s", strerror(errno));
+        uring_release(ring);
+        return -1;
+    }
+    if (uring_map(ring, &params) == -1 || uring_register(ring) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to set up io_uring, using pread: %s", strerror(errno));
+        uring_release(ring);
+        return -1;
+    }
+    M_LOG(MODULE_NAME, "io_uring: %d sources read per batch", ring->n_files);
+    return 0;
+}
+
+/**
+ * Submit the reads of all sources and wait for their completion.
+ * Each completed source is marked ready for the next pfile_read,
+ * a failed one is read again by its collector with pread
+ */
+int uring_read(uring_t *ring)
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    uint32_t tail, head, idx;
+    int submitted, completed = 0, regrow = 0, ret;
+    pfile_t *pf;
+    if (ring->fd < 0)
+        return -1;
+    tail = *ring->sq_tail;
+    for (int i = 0; i < ring->n_files; i++)
+    {
+        idx = tail & *ring->sq_mask;
+        sqe = &((struct io_uring_sqe *)ring->sqes)[idx];
+        (void)memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->fd = i;
+        sqe->addr = (uint64_t)(uintptr_t)ring->files[i]->data;
+        sqe->len = (uint32_t)ring->files[i]->cap - 1;
+        sqe->off = 0;
+        sqe->buf_index = (uint16_t)i;
+        sqe->user_data = (uint64_t)i;
+        ring->sq_array[idx] = idx;
+        tail++;
+    }
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    ring->syscalls++;
+    submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->n_files, ring->n_files, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (submitted < 0)
+    {
+        ring->fallbacks++;
+        return -1;
+    }
+    while (1)
+    {
+        head = *ring->cq_head;
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail)
+        {
+            cqe = &((struct io_uring_cqe *)ring->cqes)[head & *ring->cq_mask];
+            pf = ring->files[cqe->user_data];
+            if (cqe->res >= 0)
+            {
+                pf->len = (size_t)cqe->res;
+                pf->data[pf->len] = '\0';
+                // a full buffer may have cut the content
+                pf->truncated = pf->len + 1 >= pf->cap;
+                pf->ready = !pf->truncated || ring->frozen;
+                regrow |= !pf->ready;
+            }
+            else
+            {
+                ring->fallbacks++;
+            }
+            head++;
+            completed++;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        if (completed >= submitted)
+            break;
+        // only reached when the wait above was interrupted
+        ring->syscalls++;
+        ret = (int)syscall(__NR_io_uring_enter, ring->fd, 0, submitted - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR)
+            return -1;
+    }
+    ring->batches++;
+    if (regrow && uring_regrow(ring) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to grow the io_uring buffers, using pread: %s", strerror(errno));
+        uring_release(ring);
+        return -1;
+    }
+    return 0;
+}
+
+#else
+
+int uring_setup(uring_t *ring)
+{
+    if (ring->enabled)
+        M_ERROR(MODULE_NAME, "Built without io_uring support, using pread");
+    return -1;
+}
+
+int uring_read(uring_t *ring)
+{
+    (void)ring;
+    return -1;
+}
+
+#endif
+
+void uring_release(uring_t *ring)
+{
+    if (ring->fd >= 0)
+    {
+        M_LOG(MODULE_NAME, "io_uring: %lu batches, %lu fallbacks, %lu regrown buffers", (unsigned long)ring->batches,
+              (unsigned long)ring->fallbacks, (unsigned long)ring->regrows);
+        (void)close(ring->fd);
+    }
+    ring->fd = -1;
+    if (ring->sqes)
+        (void)munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+        (void)munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring)
+        (void)munmap(ring->sq_ring, ring->sq_ring_size);
+    ring->sqes = NULL;
+    ring->cq_ring = NULL;
+    ring->sq_ring = NULL;
+    for (int i = 0; i < ring->n_files; i++)
+    {
+        // the buffers of real-time mode stay fixed
+        ring->files[i]->fixed = ring->frozen;
+        ring->files[i]->ready = 0;
+    }
+    ring->n_files = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+
+#include "pfile.h"
+
+#define URING_MAX_FILES 160
+
+/**
+ * Optional io_uring backend: the reads of every registered source are
+ * submitted as one batch on fixed files and registered buffers, and
+ * completed by a single io_uring_enter per sample
+ */
+typedef struct
+{
+    int enabled;
+    int fd;
+    int n_files;
+    pfile_t *files[URING_MAX_FILES];
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    void *sqes;
+    size_t sqes_size;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    void *cqes;
+    /*real-time mode: the buffers are never regrown, a read that fills one stays cut*/
+    int frozen;
+    uint64_t batches;
+    uint64_t fallbacks;
+    uint64_t regrows;
+    /*io_uring_enter/io_uring_register calls made by uring_read, the preads of a regrow are counted by the sources*/
+    uint64_t syscalls;
+} uring_t;
+
+void uring_init(uring_t *ring);
+int uring_config(uring_t *ring, const char *name, const char *value);
+int uring_add(uring_t *ring, pfile_t *pf);
+int uring_setup(uring_t *ring);
+int uring_read(uring_t *ring);
+void uring_release(uring_t *ring);
+
+#endif
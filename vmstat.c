@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#include "vmstat.h"
+
+static const char *vmstat_keys[VMSTAT_N_COUNTERS] = {
+    [VMSTAT_PSWPIN] = "pswpin",
+    [VMSTAT_PSWPOUT] = "pswpout",
+    [VMSTAT_PGMAJFAULT] = "pgmajfault",
+    [VMSTAT_PGSCAN_DIRECT] = "pgscan_direct",
+    [VMSTAT_PGSCAN_KSWAPD] = "pgscan_kswapd",
+    [VMSTAT_PGSTEAL_DIRECT] = "pgsteal_direct",
+    [VMSTAT_PGSTEAL_KSWAPD] = "pgsteal_kswapd",
+    [VMSTAT_COMPACT_STALL] = "compact_stall",
+    [VMSTAT_OOM_KILL] = "oom_kill",
+};
+
+void vmstat_init(vmstat_t *vm)
+{
+    (void)memset(vm, 0, sizeof(*vm));
+    pfile_init(&vm->file);
+}
+
+int vmstat_config(vmstat_t *vm, const char *name, const char *value)
+{
+    if (EQU(name, "vm_stats"))
+    {
+        vm->enabled = atoi(value);
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+int vmstat_open(vmstat_t *vm, const char *root_dir)
+{
+    char path[MAX_BUF * 2];
+    (void)snprintf(path, sizeof(path), "%s/proc/vmstat", root_dir);
+    if (pfile_open(&vm->file, path) == -1)
+    {
+        M_ERROR(MODULE_NAME, "Unable to open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int lookup(const char *key, size_t len)
+{
+    for (int i = 0; i < VMSTAT_N_COUNTERS; i++)
+    {
+        if (strlen(vmstat_keys[i]) == len && strncmp(key, vmstat_keys[i], len) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/*match every line against the key table, once per layout of the file*/
+static void build_map(vmstat_t *vm)
+{
+    char *ptr = vm->file.data, *space, *end;
+    int id;
+    vm->n_lines = 0;
+    vm->present = 0;
+    while (ptr != NULL && *ptr != '\0' && vm->n_lines < VMSTAT_MAX_LINES)
+    {
+        space = strchr(ptr, ' ');
+        end = strchr(ptr, '\n');
+        id = space != NULL && (end == NULL || space < end) ? lookup(ptr, (size_t)(space - ptr)) : -1;
+        vm->line_map[vm->n_lines++] = (int8_t)id;
+        if (id >= 0)
+            vm->present |= 1u << id;
+        ptr = end != NULL ? end + 1 : NULL;
+    }
+}
+
+/*
+ * the layout does not change at run time: only the mapped lines are
+ * compared, -1 when the file no longer matches the map
+ */
+static int parse(vmstat_t *vm, uint64_t *values)
+{
+    char *ptr = vm->file.data, *end;
+    size_t len;
+    int id, line = 0;
+    while (ptr != NULL && *ptr != '\0')
+    {
+        if (line >= vm->n_lines)
+            return vm->n_lines == VMSTAT_MAX_LINES ? 0 : -1;
+        id = vm->line_map[line++];
+        if (id >= 0)
+        {
+            len = strlen(vmstat_keys[id]);
+            if (strncmp(ptr, vmstat_keys[id], len) != 0 || ptr[len] != ' ')
+                return -1;
+            values[id] = strtoull(ptr + len + 1, NULL, 10);
+        }
+        end = strchr(ptr, '\n');
+        ptr = end != NULL ? end + 1 : NULL;
+    }
+    return line == vm->n_lines ? 0 : -1;
+}
+
+int vmstat_read(vmstat_t *vm)
+{
+    uint64_t values[VMSTAT_N_COUNTERS];
+    struct timespec now;
+    double elapsed;
+    if (vm->file.fd < 0)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = (now.tv_sec - vm->last_read.tv_sec) + (now.tv_nsec - vm->last_read.tv_nsec) / 1.0e9;
+    vm->last_read = now;
+    if (elapsed <= 0.0)
+        elapsed = 1.0e-3;
+    // a single read of the whole file
+    if (pfile_read(&vm->file, 0) <= 0)
+        return -1;
+    (void)memset(values, 0, sizeof(values));
+    if (parse(vm, values) == -1)
+    {
+        build_map(vm);
+        if (parse(vm, values) == -1)
+            return -1;
+    }
+    for (int i = 0; i < VMSTAT_N_COUNTERS; i++)
+    {
+        if (!(vm->present & (1u << i)))
+            continue;
+        vm->rate[i] = vm->primed && values[i] >= vm->last[i] ? (values[i] - vm->last[i]) / elapsed : 0.0;
+        vm->last[i] = values[i];
+    }
+    vm->primed = 1;
+    return 0;
+}
+
+double vmstat_rate(vmstat_t *vm, vmstat_counter_t counter)
+{
+    if (vm->file.fd < 0 || !(vm->present & (1u << counter)))
+        return NAN;
+    return vm->rate[counter];
+}
+
+void vmstat_encode(vmstat_t *vm, obuf_t *ob)
+{
+    int first = 1;
+    if (vm->file.fd < 0)
+        return;
+    OBUF_LIT(ob, ",\"vmstat\":{");
+    for (int i = 0; i < VMSTAT_N_COUNTERS; i++)
+    {
+        if (!(vm->present & (1u << i)))
+            continue;
+        if (!first)
+            obuf_putc(ob, ',');
+        first = 0;
+        obuf_putc(ob, '"');
+        obuf_puts(ob, vmstat_keys[i]);
+        OBUF_LIT(ob, "\": ");
+        obuf_fixed(ob, vm->rate[i], 3);
+    }
+    obuf_putc(ob, '}');
+}
+
+void vmstat_close(vmstat_t *vm)
+{
+    pfile_close(&vm->file);
+}
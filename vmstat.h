@@ -0,0 +1,53 @@
+#ifndef VMSTAT_H
+#define VMSTAT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "sysmon.h"
+#include "obuf.h"
+#include "pfile.h"
+
+/*lines of /proc/vmstat remembered by position, the file has ~180 on recent kernels*/
+#define VMSTAT_MAX_LINES 512
+
+typedef enum
+{
+    VMSTAT_PSWPIN = 0,
+    VMSTAT_PSWPOUT,
+    VMSTAT_PGMAJFAULT,
+    VMSTAT_PGSCAN_DIRECT,
+    VMSTAT_PGSCAN_KSWAPD,
+    VMSTAT_PGSTEAL_DIRECT,
+    VMSTAT_PGSTEAL_KSWAPD,
+    VMSTAT_COMPACT_STALL,
+    VMSTAT_OOM_KILL,
+    VMSTAT_N_COUNTERS
+} vmstat_counter_t;
+
+typedef struct
+{
+    int enabled;
+    pfile_t file;
+    /*counter of each line of the file, -1 for the lines that are not reported*/
+    int8_t line_map[VMSTAT_MAX_LINES];
+    int n_lines;
+    /*counters found in the file (older kernels lack some of them)*/
+    uint32_t present;
+    uint64_t last[VMSTAT_N_COUNTERS];
+    /*events per second*/
+    double rate[VMSTAT_N_COUNTERS];
+    int primed;
+    struct timespec last_read;
+} vmstat_t;
+
+void vmstat_init(vmstat_t *vm);
+int vmstat_config(vmstat_t *vm, const char *name, const char *value);
+int vmstat_open(vmstat_t *vm, const char *root_dir);
+int vmstat_read(vmstat_t *vm);
+/*rate of a counter, NaN if it is not available*/
+double vmstat_rate(vmstat_t *vm, vmstat_counter_t counter);
+void vmstat_encode(vmstat_t *vm, obuf_t *ob);
+void vmstat_close(vmstat_t *vm);
+
+#endif